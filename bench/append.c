@@ -0,0 +1,148 @@
+// Copyright 2016 Mitchell Kember. Subject to the MIT License.
+
+#include "bench.h"
+
+#include "buffer.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Number of pushes timed together in one sample.
+#define BATCH 64
+
+// Shared state for the append benchmark.
+struct Append {
+	struct Buffer log;
+	int batches;          // batches per thread
+	long long *samples;   // 'batches' samples for each thread
+};
+
+// Argument for an append thread.
+struct AppendArg {
+	struct Append *shared;
+	int index;
+};
+
+static void *run_append(void *ptr) {
+	struct AppendArg *arg = ptr;
+	struct Append *a = arg->shared;
+	long long *samples = a->samples + arg->index * a->batches;
+	for (int i = 0; i < a->batches; i++) {
+		long long start = monotonic_ns();
+		for (int j = 0; j < BATCH; j += 2) {
+			buf_push2(&a->log, 'P', (unsigned char)j);
+		}
+		samples[i] = (monotonic_ns() - start) / (BATCH / 2);
+	}
+	return NULL;
+}
+
+// Labels for the buffer modes, indexed by 'enum BufferMode'.
+static const char *const mode_labels[] = {
+	"append/mutex", "append/atomic", "append/per-thread"
+};
+
+// Runs one measurement with 'threads' threads logging to one buffer.
+static void run_loggers(const struct BenchContext *ctx, int threads,
+		enum BufferMode mode) {
+	struct Append a = { .batches = MAX(1, ctx->samples / threads) };
+	size_t n = (size_t)(threads * a.batches);
+	switch (mode) {
+	case BUF_LOCKED:
+		buf_init(&a.log, n * BATCH);
+		break;
+	case BUF_APPEND:
+		buf_init_log(&a.log, n * BATCH);
+		break;
+	case BUF_PER_THREAD:
+		buf_init_events(&a.log, n * BATCH);
+		break;
+	}
+	a.samples = malloc(n * sizeof *a.samples);
+	struct AppendArg *args = malloc((size_t)threads * sizeof *args);
+	pthread_t *handles = malloc((size_t)threads * sizeof *handles);
+	for (int i = 0; i < threads; i++) {
+		args[i] = (struct AppendArg){ &a, i };
+	}
+	start_threads(ctx, handles, threads, run_append, args, sizeof *args);
+	join_threads(handles, threads);
+
+	report(ctx, mode_labels[mode], threads, a.samples, n);
+	buf_free(&a.log);
+	free(a.samples);
+	free(args);
+	free(handles);
+}
+
+// Measures the cost of 'buf_push2' with 1, 2, 4, ... threads logging to the
+// same buffer, with the mutex, in append mode, and in per-thread mode (which
+// includes taking a timestamp for every push).
+static void append(const struct BenchContext *ctx) {
+	for (int threads = 1; threads <= ctx->max_threads; threads *= 2) {
+		run_loggers(ctx, threads, BUF_LOCKED);
+		run_loggers(ctx, threads, BUF_APPEND);
+		run_loggers(ctx, threads, BUF_PER_THREAD);
+	}
+}
+
+const struct Benchmark bench_append = {
+	.name = "append",
+	.description = "Event log push cost with each buffer mode",
+	.run = append
+};
+
+// Number of pushes timed together in one sample of the growth benchmark.
+#define GROW_BATCH 4096
+
+// An array that doubles its capacity with 'realloc' when it fills up, which is
+// the obvious alternative to a segmented buffer.
+struct Vector {
+	unsigned char *arr;
+	size_t len;
+	size_t cap;
+};
+
+static void vector_push(struct Vector *v, unsigned char c) {
+	if (v->len == v->cap) {
+		v->cap = MAX(v->cap * 2, GROW_BATCH);
+		v->arr = realloc(v->arr, v->cap);
+	}
+	v->arr[v->len++] = c;
+}
+
+// Measures the cost of pushing to a buffer that keeps growing, with a segmented
+// buffer and with a doubling array. Each sample covers GROW_BATCH pushes, so
+// the tail shows the pauses when the array is copied.
+static void grow(const struct BenchContext *ctx) {
+	long long *samples = malloc((size_t)ctx->samples * sizeof *samples);
+	struct Vector v = { NULL, 0, 0 };
+	for (int i = 0; i < ctx->samples; i++) {
+		long long start = monotonic_ns();
+		for (int j = 0; j < GROW_BATCH; j++) {
+			vector_push(&v, (unsigned char)j);
+		}
+		samples[i] = (monotonic_ns() - start) / GROW_BATCH;
+	}
+	report(ctx, "grow/realloc", 1, samples, (size_t)ctx->samples);
+	free(v.arr);
+
+	struct Buffer buf;
+	buf_init_segmented(&buf, BUF_APPEND);
+	for (int i = 0; i < ctx->samples; i++) {
+		long long start = monotonic_ns();
+		for (int j = 0; j < GROW_BATCH; j++) {
+			buf_push(&buf, (unsigned char)j);
+		}
+		samples[i] = (monotonic_ns() - start) / GROW_BATCH;
+	}
+	report(ctx, "grow/segmented", 1, samples, (size_t)ctx->samples);
+	buf_free(&buf);
+	free(samples);
+}
+
+const struct Benchmark bench_grow = {
+	.name = "grow",
+	.description = "Push cost to a growing segmented buffer and doubling array",
+	.run = grow
+};
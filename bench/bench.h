@@ -0,0 +1,55 @@
+// Copyright 2016 Mitchell Kember. Subject to the MIT License.
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Settings shared by all benchmarks for one run.
+struct BenchContext {
+	int samples;         // number of samples to collect per measurement
+	int max_threads;     // upper bound on threads a benchmark may use
+	const int *cpus;     // CPUs to pin threads to (round robin)
+	int n_cpus;          // number of CPUs in 'cpus'
+	const char *where;   // name of the placement, for reports
+};
+
+// A benchmark runs its measurements and prints one report line for each.
+struct Benchmark {
+	const char *name;
+	const char *description;
+	void (*run)(const struct BenchContext *ctx);
+};
+
+// Declarations for benchmarks defined in the other files.
+extern const struct Benchmark bench_pingpong;
+extern const struct Benchmark bench_throughput;
+extern const struct Benchmark bench_uncontended;
+extern const struct Benchmark bench_timeout;
+extern const struct Benchmark bench_fanout;
+extern const struct Benchmark bench_philosophers;
+extern const struct Benchmark bench_ingredients;
+extern const struct Benchmark bench_mutex;
+extern const struct Benchmark bench_append;
+extern const struct Benchmark bench_grow;
+extern const struct Benchmark bench_pool;
+
+// Prints the report table header.
+void print_report_header(void);
+
+// Sorts the 'n' nanosecond samples and prints min, median, p99 and p99.9 on a
+// line labeled 'label'.
+void report(const struct BenchContext *ctx, const char *label, int threads,
+		long long *samples, size_t n);
+
+// Creates 'n' threads running 'fn', passing each one 'args + i * arg_size',
+// and pins thread 'i' to 'ctx->cpus[i % ctx->n_cpus]'.
+void start_threads(const struct BenchContext *ctx, pthread_t *threads, int n,
+		void *(*fn)(void *), void *args, size_t arg_size);
+
+// Joins 'n' threads.
+void join_threads(pthread_t *threads, int n);
+
+#endif
@@ -0,0 +1,141 @@
+// Copyright 2016 Mitchell Kember. Subject to the MIT License.
+
+#include "bench.h"
+
+#include "semaphore.h"
+#include "util.h"
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Number of untimed rounds before collecting samples.
+#define WARMUP 100
+
+// Number of ingredients in the generalized cigarette smokers problem.
+#define N_INGREDIENTS 3
+
+// Shared state for the ingredients benchmark. The agent signals one of the
+// ingredient semaphores and the smoker acknowledges it. With futexes, the
+// smoker can only wait on one semaphore, so (as in problem 16) there is a
+// pusher thread per ingredient forwarding to 'ready'. With eventfds, the smoker
+// waits on all the ingredients directly with 'sema_wait_any'.
+struct Ingredients {
+	bool wait_any;
+	int kinds;
+	int rounds;
+	Semaphore ingredients[SEMA_WAIT_ANY_MAX];
+	Semaphore ready;
+	Semaphore ack;
+	atomic_bool stop;
+	long long *samples;
+};
+
+// Argument for an ingredients thread: index 0 is the agent, index 1 is the
+// smoker, and the rest are pushers.
+struct IngredientsArg {
+	struct Ingredients *shared;
+	int index;
+};
+
+static void *run_ingredients(void *ptr) {
+	struct IngredientsArg *arg = ptr;
+	struct Ingredients *g = arg->shared;
+	if (arg->index == 0) {
+		for (int i = 0; i < g->rounds; i++) {
+			long long start = monotonic_ns();
+			sema_signal(g->ingredients[i % g->kinds]);
+			sema_wait(g->ack);
+			long long elapsed = monotonic_ns() - start;
+			if (i >= WARMUP) {
+				g->samples[i - WARMUP] = elapsed / 2;
+			}
+		}
+		atomic_store(&g->stop, true);
+		if (!g->wait_any) {
+			for (int i = 0; i < g->kinds; i++) {
+				sema_signal(g->ingredients[i]);
+			}
+		}
+	} else if (arg->index == 1) {
+		for (int i = 0; i < g->rounds; i++) {
+			if (g->wait_any) {
+				sema_wait_any(g->ingredients, (size_t)g->kinds);
+			} else {
+				sema_wait(g->ready);
+			}
+			sema_signal(g->ack);
+		}
+	} else {
+		Semaphore ingredient = g->ingredients[arg->index - 2];
+		for (;;) {
+			sema_wait(ingredient);
+			if (atomic_load(&g->stop)) {
+				break;
+			}
+			sema_signal(g->ready);
+		}
+	}
+	return NULL;
+}
+
+// Runs one measurement with 'kinds' ingredients.
+static void run_kinds(const struct BenchContext *ctx, int kinds,
+		bool wait_any) {
+	if (wait_any && !sema_set_backend(SEMA_EVENTFD)) {
+		return;
+	}
+	struct Ingredients g = {
+		.wait_any = wait_any,
+		.kinds = kinds,
+		.rounds = ctx->samples + WARMUP,
+		.stop = false,
+		.samples = malloc((size_t)ctx->samples * sizeof *g.samples)
+	};
+	for (int i = 0; i < kinds; i++) {
+		g.ingredients[i] = sema_create(0, true);
+	}
+	sema_set_backend(SEMA_FUTEX);
+	g.ready = sema_create(0, true);
+	g.ack = sema_create(0, true);
+
+	int n_threads = wait_any ? 2 : kinds + 2;
+	struct IngredientsArg *args = malloc((size_t)n_threads * sizeof *args);
+	pthread_t *threads = malloc((size_t)n_threads * sizeof *threads);
+	for (int i = 0; i < n_threads; i++) {
+		args[i] = (struct IngredientsArg){ &g, i };
+	}
+	start_threads(ctx, threads, n_threads, run_ingredients, args, sizeof *args);
+	join_threads(threads, n_threads);
+
+	char label[48];
+	snprintf(label, sizeof label, "ingredients/%d/%s", kinds,
+			wait_any ? "wait_any" : "pushers");
+	report(ctx, label, n_threads, g.samples, (size_t)ctx->samples);
+	for (int i = 0; i < kinds; i++) {
+		sema_destroy(g.ingredients[i]);
+	}
+	sema_destroy(g.ready);
+	sema_destroy(g.ack);
+	free(g.samples);
+	free(args);
+	free(threads);
+}
+
+// Measures the latency of waking a thread waiting on one of K semaphores, using
+// pusher threads on futex semaphores and 'sema_wait_any' on eventfds (skipped
+// where eventfds are not available).
+static void ingredients(const struct BenchContext *ctx) {
+	int max_kinds = MIN(SEMA_WAIT_ANY_MAX, ctx->max_threads - 2);
+	for (int kinds = N_INGREDIENTS; kinds <= MAX(N_INGREDIENTS, max_kinds);
+			kinds *= 2) {
+		run_kinds(ctx, kinds, false);
+		run_kinds(ctx, kinds, true);
+	}
+}
+
+const struct Benchmark bench_ingredients = {
+	.name = "ingredients",
+	.description = "Waking a thread waiting on one of K semaphores",
+	.run = ingredients
+};
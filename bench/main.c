@@ -0,0 +1,174 @@
+// Copyright 2016 Mitchell Kember. Subject to the MIT License.
+
+#include "bench.h"
+
+#include "topology.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Default values for some parameters.
+#define DEFAULT_SAMPLES 10000
+#define DEFAULT_THREADS 8
+
+// Maximum values for some parameters.
+#define MAX_SAMPLES 10000000
+#define MAX_THREADS 64
+
+// Helper macros for stringification.
+#define S_(x) #x
+#define S(x) S_(x)
+
+// The usage message for the program.
+static const char *const usage_message =
+	"usage: semaphores-bench [options]\n"
+	"\n"
+	"  Default\n"
+	"    semaphores-bench -n " S(DEFAULT_SAMPLES) " -m " S(DEFAULT_THREADS) "\n"
+	"\n"
+	"  Options\n"
+	"    -b NAME  Run only the benchmark NAME (see -l)\n"
+	"    -n N     Collect N samples per measurement\n"
+	"    -m N     Use at most N threads\n"
+	"    -l       List the benchmarks\n"
+	"\n"
+	"  Every benchmark runs with its threads on one logical CPU, on the SMT\n"
+	"  siblings of one core, and spread over separate cores, when possible.\n"
+	"  Times are in nanoseconds.\n"
+	"\n";
+
+#undef S
+#undef S_
+
+// All the benchmarks, in the order they run.
+static const struct Benchmark *const benchmarks[] = {
+	&bench_pingpong,
+	&bench_throughput,
+	&bench_uncontended,
+	&bench_timeout,
+	&bench_fanout,
+	&bench_philosophers,
+	&bench_ingredients,
+	&bench_mutex,
+	&bench_append,
+	&bench_grow,
+	&bench_pool,
+};
+
+#define N_BENCHMARKS (sizeof benchmarks / sizeof benchmarks[0])
+
+// All placements, in the order they run.
+static const enum Placement placements[] = {
+	PLACE_ONE_CPU,
+	PLACE_SMT_SIBLINGS,
+	PLACE_SPREAD
+};
+
+#define N_PLACEMENTS (sizeof placements / sizeof placements[0])
+
+// Prints the list of benchmarks.
+static void print_benchmarks(void) {
+	for (size_t i = 0; i < N_BENCHMARKS; i++) {
+		printf("%-12s %s\n", benchmarks[i]->name, benchmarks[i]->description);
+	}
+}
+
+// Runs 'bench' once for every placement.
+static void run_benchmark(const struct Benchmark *bench,
+		const struct Topology *topo, int samples, int max_threads) {
+	for (size_t i = 0; i < N_PLACEMENTS; i++) {
+		int cpus[MAX_CPUS];
+		int n_cpus = topo_choose(topo, placements[i], cpus, max_threads);
+		const char *where = placement_name(placements[i]);
+		if (n_cpus == 0) {
+			printf("%-32s %-8s not available on this machine\n",
+					bench->name, where);
+			continue;
+		}
+		struct BenchContext ctx = {
+			.samples = samples,
+			.max_threads = max_threads,
+			.cpus = cpus,
+			.n_cpus = n_cpus,
+			.where = where
+		};
+		bench->run(&ctx);
+	}
+}
+
+int main(int argc, char **argv) {
+	setup_util(argv[0]);
+	const char *only = NULL;
+	int samples = DEFAULT_SAMPLES;
+	int max_threads = DEFAULT_THREADS;
+
+	// Get command line options.
+	int c;
+	extern char *optarg;
+	extern int optind;
+	while ((c = getopt(argc, argv, "b:n:m:lh")) != -1) {
+		switch (c) {
+		case 'b':
+			only = optarg;
+			break;
+		case 'n':
+			if (!parse_int(&samples, optarg)) {
+				return 1;
+			}
+			if (samples <= 0 || samples > MAX_SAMPLES) {
+				printf_error("%s: samples must be between 1 and %d",
+						optarg, MAX_SAMPLES);
+				return 1;
+			}
+			break;
+		case 'm':
+			if (!parse_int(&max_threads, optarg)) {
+				return 1;
+			}
+			if (max_threads < 2 || max_threads > MAX_THREADS) {
+				printf_error("%s: threads must be between 2 and %d",
+						optarg, MAX_THREADS);
+				return 1;
+			}
+			break;
+		case 'l':
+			print_benchmarks();
+			return 0;
+		case 'h':
+			fputs(usage_message, stdout);
+			return 0;
+		case '?':
+			fputs(usage_message, stderr);
+			return 1;
+		}
+	}
+	if (optind != argc) {
+		fputs(usage_message, stderr);
+		return 1;
+	}
+
+	struct Topology topo;
+	if (!topo_load(&topo)) {
+		// Without topology information, run everything unpinned.
+		topo.n_cpus = 1;
+		topo.cpu[0] = -1;
+		topo.core[0] = 0;
+	}
+
+	bool found = false;
+	print_report_header();
+	for (size_t i = 0; i < N_BENCHMARKS; i++) {
+		if (only == NULL || strcmp(only, benchmarks[i]->name) == 0) {
+			run_benchmark(benchmarks[i], &topo, samples, max_threads);
+			found = true;
+		}
+	}
+	if (!found) {
+		printf_error("%s: no such benchmark", only);
+		return 1;
+	}
+	return 0;
+}
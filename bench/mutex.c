@@ -0,0 +1,79 @@
+// Copyright 2016 Mitchell Kember. Subject to the MIT License.
+
+#include "bench.h"
+
+#include "semaphore.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Shared state for the mutex benchmark.
+struct Mutex {
+	Semaphore mutex;
+	int rounds;           // rounds per thread
+	long counter;         // guarded by 'mutex'
+	long long *samples;   // 'rounds' samples for each thread
+};
+
+// Argument for a mutex thread.
+struct MutexArg {
+	struct Mutex *shared;
+	int index;
+};
+
+static void *run_mutex(void *ptr) {
+	struct MutexArg *arg = ptr;
+	struct Mutex *m = arg->shared;
+	long long *samples = m->samples + arg->index * m->rounds;
+	for (int i = 0; i < m->rounds; i++) {
+		long long start = monotonic_ns();
+		sema_wait(m->mutex);
+		samples[i] = monotonic_ns() - start;
+		m->counter++;
+		sema_signal(m->mutex);
+	}
+	return NULL;
+}
+
+// Runs one measurement with 'threads' threads sharing one mutex.
+static void run_contenders(const struct BenchContext *ctx, int threads,
+		bool fifo) {
+	struct Mutex m = {
+		.mutex = fifo ? sema_create_fifo("mutex", 1, true)
+			: sema_create_named("mutex", 1, true),
+		.rounds = MAX(1, ctx->samples / threads),
+		.counter = 0
+	};
+	size_t n = (size_t)(threads * m.rounds);
+	m.samples = malloc(n * sizeof *m.samples);
+	struct MutexArg *args = malloc((size_t)threads * sizeof *args);
+	pthread_t *handles = malloc((size_t)threads * sizeof *handles);
+	for (int i = 0; i < threads; i++) {
+		args[i] = (struct MutexArg){ &m, i };
+	}
+	start_threads(ctx, handles, threads, run_mutex, args, sizeof *args);
+	join_threads(handles, threads);
+
+	report(ctx, fifo ? "mutex/fifo" : "mutex/unfair", threads, m.samples, n);
+	sema_destroy(m.mutex);
+	free(m.samples);
+	free(args);
+	free(handles);
+}
+
+// Measures how long threads wait to acquire a mutex with 2, 4, ... threads
+// contending for it, using the default (unfair) semaphore and a FIFO one. The
+// median reflects throughput, and the tail reflects fairness.
+static void mutex(const struct BenchContext *ctx) {
+	for (int threads = 2; threads <= ctx->max_threads; threads *= 2) {
+		run_contenders(ctx, threads, false);
+		run_contenders(ctx, threads, true);
+	}
+}
+
+const struct Benchmark bench_mutex = {
+	.name = "mutex",
+	.description = "Acquire latency of a contended unfair and FIFO mutex",
+	.run = mutex
+};
@@ -0,0 +1,187 @@
+// Copyright 2016 Mitchell Kember. Subject to the MIT License.
+
+#include "bench.h"
+
+#include "delay.h"
+#include "problems.h"
+#include "semaphore.h"
+#include "util.h"
+
+#include <stdalign.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Number of meals timed together in one sample.
+#define BATCH 64
+
+// Problem number of the dining philosophers.
+#define PROBLEM 14
+
+// Philosopher counts swept when running the real problem, which gives each
+// table about half as many forks as philosophers (rounded up to be odd).
+static const int problem_philosophers[] = { 10, 40, 160, 640 };
+
+// Upper bound on meals eaten for each philosopher count, so that the large
+// tables run fewer iterations.
+#define MAX_PROBLEM_MEALS 2000000
+
+// A meal counter padded to a cache line of its own.
+struct PaddedCount {
+	alignas(CACHE_LINE_SIZE) long value;
+};
+
+// Shared state for the philosophers benchmark. Exactly one of the packed and
+// padded layouts is in use, depending on 'padded'.
+struct Philosophers {
+	int seats;
+	int batches;              // batches per philosopher
+	bool padded;
+	struct Semaphore *packed_forks;
+	long *packed_meals;
+	struct SemaArray padded_forks;
+	struct PaddedCount *padded_meals;
+	long long *samples;       // 'batches' samples for each philosopher
+};
+
+// Argument for a philosopher thread.
+struct PhilosopherArg {
+	struct Philosophers *shared;
+	int index;
+};
+
+static Semaphore fork_at(struct Philosophers *p, int i) {
+	return p->padded ? sema_at(&p->padded_forks, (size_t)i)
+		: &p->packed_forks[i];
+}
+
+static void *run_philosopher(void *ptr) {
+	struct PhilosopherArg *arg = ptr;
+	struct Philosophers *p = arg->shared;
+	int i = arg->index;
+	// Always pick up the lower-numbered fork first to avoid deadlock.
+	int first = MIN(i, (i + 1) % p->seats);
+	int second = MAX(i, (i + 1) % p->seats);
+	long *meals = p->padded ? &p->padded_meals[i].value : &p->packed_meals[i];
+	long long *samples = p->samples + i * p->batches;
+	for (int b = 0; b < p->batches; b++) {
+		long long start = monotonic_ns();
+		for (int j = 0; j < BATCH; j++) {
+			sema_wait(fork_at(p, first));
+			sema_wait(fork_at(p, second));
+			(*meals)++;
+			sema_signal(fork_at(p, second));
+			sema_signal(fork_at(p, first));
+		}
+		samples[b] = (monotonic_ns() - start) / BATCH;
+	}
+	return NULL;
+}
+
+// Runs one table of 'seats' philosophers with the given layout.
+static void run_table(const struct BenchContext *ctx, int seats, bool padded) {
+	struct Philosophers p = {
+		.seats = seats,
+		.batches = MAX(1, ctx->samples / seats),
+		.padded = padded
+	};
+	if (padded) {
+		sema_array_init(&p.padded_forks, "forks", (size_t)seats, 1, true);
+		p.padded_meals = aligned_alloc(CACHE_LINE_SIZE,
+				(size_t)seats * sizeof *p.padded_meals);
+		for (int i = 0; i < seats; i++) {
+			p.padded_meals[i].value = 0;
+		}
+	} else {
+		p.packed_forks = malloc((size_t)seats * sizeof *p.packed_forks);
+		for (int i = 0; i < seats; i++) {
+			sema_init(&p.packed_forks[i], "forks", 1);
+		}
+		p.packed_meals = calloc((size_t)seats, sizeof *p.packed_meals);
+	}
+	size_t n = (size_t)(seats * p.batches);
+	p.samples = malloc(n * sizeof *p.samples);
+	struct PhilosopherArg *args = malloc((size_t)seats * sizeof *args);
+	pthread_t *threads = malloc((size_t)seats * sizeof *threads);
+	for (int i = 0; i < seats; i++) {
+		args[i] = (struct PhilosopherArg){ &p, i };
+	}
+	start_threads(ctx, threads, seats, run_philosopher, args, sizeof *args);
+	join_threads(threads, seats);
+
+	char label[32];
+	snprintf(label, sizeof label, "philosophers/%s",
+			padded ? "padded" : "packed");
+	report(ctx, label, seats, p.samples, n);
+	if (padded) {
+		sema_array_destroy(&p.padded_forks);
+		free(p.padded_meals);
+	} else {
+		for (int i = 0; i < seats; i++) {
+			sema_fini(&p.packed_forks[i]);
+		}
+		free(p.packed_forks);
+		free(p.packed_meals);
+	}
+	free(p.samples);
+	free(args);
+	free(threads);
+}
+
+// Runs iterations of problem 14 itself with 'count' philosophers and its padded
+// or packed layout, and reports the time per meal in each iteration. Delays are
+// turned off, and problem threads are not pinned.
+static void run_problem(const struct BenchContext *ctx, int count,
+		bool padded) {
+	char settings[64];
+	snprintf(settings, sizeof settings, "threads=%d,forks=%d,padded=%d",
+			count, count / 2 | 1, padded);
+	if (!set_problem_params(PROBLEM, settings)) {
+		exit(1);
+	}
+	long long meals = (long long)count * (count / 2 | 1);
+	int n = (int)MAX(1, MIN(ctx->samples, MAX_PROBLEM_MEALS / meals));
+	long long *samples = malloc((size_t)n * sizeof *samples);
+	ProblemFn function = get_problem_function(PROBLEM);
+	for (int i = 0; i < n; i++) {
+		long long start = monotonic_ns();
+		if (!function(true)) {
+			printf_error("problem %d failed with %s", PROBLEM, settings);
+			exit(1);
+		}
+		samples[i] = (monotonic_ns() - start) / meals;
+	}
+	char label[48];
+	snprintf(label, sizeof label, "philosophers/problem/%d/%s", count,
+			padded ? "padded" : "packed");
+	report(ctx, label, count, samples, (size_t)n);
+	free(samples);
+}
+
+// Measures the cost of a meal (two forks and a counter update) with as many
+// philosophers as threads allowed, once with the forks and counters packed
+// together and once with each on its own cache line. Then measures the meal
+// cost in problem 14 with growing numbers of philosophers, with both of its
+// layouts, restoring its parameters afterwards.
+static void philosophers(const struct BenchContext *ctx) {
+	int seats = MAX(2, ctx->max_threads);
+	run_table(ctx, seats, false);
+	run_table(ctx, seats, true);
+
+	const struct ProblemParam *params = get_problem_params(PROBLEM);
+	int saved[3] = { *params[0].value, *params[1].value, *params[2].value };
+	delay_configure("none");
+	for (size_t i = 0; i < sizeof problem_philosophers
+			/ sizeof problem_philosophers[0]; i++) {
+		run_problem(ctx, problem_philosophers[i], false);
+		run_problem(ctx, problem_philosophers[i], true);
+	}
+	for (int i = 0; i < 3; i++) {
+		*params[i].value = saved[i];
+	}
+}
+
+const struct Benchmark bench_philosophers = {
+	.name = "philosophers",
+	.description = "Meal cost with padded forks, and in problem 14 by size",
+	.run = philosophers
+};
@@ -0,0 +1,52 @@
+// Copyright 2016 Mitchell Kember. Subject to the MIT License.
+
+#include "bench.h"
+
+#include "delay.h"
+#include "pool.h"
+#include "problems.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Maximum number of iterations timed for each problem.
+#define MAX_ITERATIONS 1000
+
+// Runs 'n' iterations of 'problem' and reports the time each one took.
+static void run_problem(const struct BenchContext *ctx, int problem, int n,
+		long long *samples, bool pooled) {
+	ProblemFn function = get_problem_function(problem);
+	pool_set_enabled(pooled);
+	for (int i = 0; i < n; i++) {
+		long long start = monotonic_ns();
+		function(true);
+		samples[i] = monotonic_ns() - start;
+	}
+	char label[32];
+	snprintf(label, sizeof label, "problem/%02d/%s", problem,
+			pooled ? "pool" : "create");
+	report(ctx, label, 1, samples, (size_t)n);
+}
+
+// Measures the time for one positive iteration of every problem, creating new
+// threads for each iteration and taking them from the pool. Delays are turned
+// off so that thread startup is not hidden by sleeping. Iterations per second
+// is one billion divided by the median. Problem threads are not pinned.
+static void pool(const struct BenchContext *ctx) {
+	delay_configure("none");
+	int n = MIN(ctx->samples, MAX_ITERATIONS);
+	long long *samples = malloc((size_t)n * sizeof *samples);
+	for (int problem = 1; problem <= N_PROBLEMS; problem++) {
+		run_problem(ctx, problem, n, samples, false);
+		run_problem(ctx, problem, n, samples, true);
+	}
+	pool_set_enabled(true);
+	free(samples);
+}
+
+const struct Benchmark bench_pool = {
+	.name = "pool",
+	.description = "Time per problem iteration with and without the pool",
+	.run = pool
+};
@@ -0,0 +1,385 @@
+// Copyright 2016 Mitchell Kember. Subject to the MIT License.
+
+#include "bench.h"
+
+#include "semaphore.h"
+#include "util.h"
+
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Number of untimed rounds before collecting samples.
+#define WARMUP 100
+
+// Number of operations timed together in one sample, for operations that are
+// too fast to time individually.
+#define BATCH 64
+
+// Shared state for the ping-pong benchmark.
+struct PingPong {
+	Semaphore ping;
+	Semaphore pong;
+	int rounds;
+	long long *samples;
+};
+
+// Argument for a ping-pong thread: role 0 pings and measures, role 1 pongs.
+struct PingPongArg {
+	struct PingPong *shared;
+	int role;
+};
+
+static void *run_pingpong(void *ptr) {
+	struct PingPongArg *arg = ptr;
+	struct PingPong *p = arg->shared;
+	for (int i = 0; i < p->rounds; i++) {
+		if (arg->role == 0) {
+			long long start = monotonic_ns();
+			sema_signal(p->ping);
+			sema_wait(p->pong);
+			long long elapsed = monotonic_ns() - start;
+			if (i >= WARMUP) {
+				p->samples[i - WARMUP] = elapsed / 2;
+			}
+		} else {
+			sema_wait(p->ping);
+			sema_signal(p->pong);
+		}
+	}
+	return NULL;
+}
+
+// Measures signal-to-wake latency as half of a ping-pong round trip.
+static void pingpong(const struct BenchContext *ctx) {
+	struct PingPong p = {
+		.ping = sema_create(0, true),
+		.pong = sema_create(0, true),
+		.rounds = ctx->samples + WARMUP,
+		.samples = malloc((size_t)ctx->samples * sizeof *p.samples)
+	};
+	struct PingPongArg args[2] = { { &p, 0 }, { &p, 1 } };
+	pthread_t threads[2];
+	start_threads(ctx, threads, 2, run_pingpong, args, sizeof args[0]);
+	join_threads(threads, 2);
+	report(ctx, "pingpong", 2, p.samples, (size_t)ctx->samples);
+	sema_destroy(p.ping);
+	sema_destroy(p.pong);
+	free(p.samples);
+}
+
+const struct Benchmark bench_pingpong = {
+	.name = "pingpong",
+	.description = "Signal-to-wake latency between two threads",
+	.run = pingpong
+};
+
+// Shared state for the throughput benchmark.
+struct Throughput {
+	Semaphore sem;
+	int producers;
+	int batches;          // batches per producer
+	long long *samples;   // 'batches' samples for each producer
+};
+
+// Argument for a throughput thread: index 0 consumes, the rest produce.
+struct ThroughputArg {
+	struct Throughput *shared;
+	int index;
+};
+
+static void *run_throughput(void *ptr) {
+	struct ThroughputArg *arg = ptr;
+	struct Throughput *t = arg->shared;
+	if (arg->index == 0) {
+		int total = t->producers * t->batches * BATCH;
+		for (int i = 0; i < total; i++) {
+			sema_wait(t->sem);
+		}
+		return NULL;
+	}
+	long long *samples = t->samples + (arg->index - 1) * t->batches;
+	for (int i = 0; i < t->batches; i++) {
+		long long start = monotonic_ns();
+		for (int j = 0; j < BATCH; j++) {
+			sema_signal(t->sem);
+		}
+		samples[i] = (monotonic_ns() - start) / BATCH;
+	}
+	return NULL;
+}
+
+// Measures the cost of a signal with 1, 2, 4, ... producers signaling the same
+// semaphore while one consumer drains it.
+static void throughput(const struct BenchContext *ctx) {
+	for (int producers = 1; producers < ctx->max_threads; producers *= 2) {
+		struct Throughput t = {
+			.sem = sema_create(0, true),
+			.producers = producers,
+			.batches = MAX(1, ctx->samples / producers)
+		};
+		size_t n = (size_t)(producers * t.batches);
+		t.samples = malloc(n * sizeof *t.samples);
+		int n_threads = producers + 1;
+		struct ThroughputArg *args = malloc((size_t)n_threads * sizeof *args);
+		pthread_t *threads = malloc((size_t)n_threads * sizeof *threads);
+		for (int i = 0; i < n_threads; i++) {
+			args[i] = (struct ThroughputArg){ &t, i };
+		}
+		start_threads(ctx, threads, n_threads, run_throughput, args,
+				sizeof *args);
+		join_threads(threads, n_threads);
+
+		char label[32];
+		snprintf(label, sizeof label, "throughput/%dp", producers);
+		report(ctx, label, n_threads, t.samples, n);
+		sema_destroy(t.sem);
+		free(t.samples);
+		free(args);
+		free(threads);
+	}
+}
+
+const struct Benchmark bench_throughput = {
+	.name = "throughput",
+	.description = "Signal cost with 1..N producers and one consumer",
+	.run = throughput
+};
+
+static void *run_uncontended(void *ptr) {
+	const struct BenchContext *ctx = ptr;
+	Semaphore s = sema_create(1, true);
+	long long *samples = malloc((size_t)ctx->samples * sizeof *samples);
+	for (int i = 0; i < ctx->samples; i++) {
+		long long start = monotonic_ns();
+		for (int j = 0; j < BATCH; j++) {
+			sema_wait(s);
+			sema_signal(s);
+		}
+		samples[i] = (monotonic_ns() - start) / BATCH;
+	}
+	report(ctx, "uncontended", 1, samples, (size_t)ctx->samples);
+	sema_destroy(s);
+	free(samples);
+	return NULL;
+}
+
+// Measures a wait/signal pair on a semaphore no other thread touches.
+static void uncontended(const struct BenchContext *ctx) {
+	pthread_t thread;
+	start_threads(ctx, &thread, 1, run_uncontended, (void *)ctx, 0);
+	join_threads(&thread, 1);
+}
+
+const struct Benchmark bench_uncontended = {
+	.name = "uncontended",
+	.description = "Wait/signal pair with no other threads",
+	.run = uncontended
+};
+
+// How long the timed waits in the timeout benchmark wait, in nanoseconds.
+#define TIMEOUT_NS 10000
+
+// Backends the timeout benchmark checks, and their labels.
+static const struct {
+	const char *label;
+	enum SemaBackend backend;
+} timeout_backends[] = {
+	{ "futex", SEMA_FUTEX },
+	{ "fifo", SEMA_FIFO },
+	{ "eventfd", SEMA_EVENTFD }
+};
+
+// Exits if 's' does not hold exactly one permit and have no waiters: a failed
+// 'sema_try_wait' or timed-out 'sema_wait_timeout' must leave both unchanged.
+static void check_one_permit(Semaphore s, const char *label) {
+	int waiters = atomic_load(&s->waiters);
+	sema_signal(s);
+	bool ok = waiters == 0 && sema_try_wait(s) == SEMA_ACQUIRED
+		&& sema_try_wait(s) == SEMA_TIMED_OUT;
+	if (!ok) {
+		printf_error("%s: timed-out waits changed the semaphore", label);
+		exit(1);
+	}
+}
+
+static void *run_timeout(void *ptr) {
+	const struct BenchContext *ctx = ptr;
+	enum SemaBackend saved = sema_get_backend();
+	long long *samples = malloc((size_t)ctx->samples * sizeof *samples);
+	for (size_t b = 0; b < sizeof timeout_backends / sizeof timeout_backends[0];
+			b++) {
+		if (!sema_set_backend(timeout_backends[b].backend)) {
+			continue;
+		}
+		char label[32];
+		Semaphore s = sema_create(1, true);
+		snprintf(label, sizeof label, "timeout/try/%s",
+				timeout_backends[b].label);
+		if (sema_try_wait(s) != SEMA_ACQUIRED) {
+			printf_error("%s: could not take the only permit", label);
+			exit(1);
+		}
+		for (int i = 0; i < ctx->samples; i++) {
+			long long start = monotonic_ns();
+			for (int j = 0; j < BATCH; j++) {
+				sema_try_wait(s);
+			}
+			samples[i] = (monotonic_ns() - start) / BATCH;
+		}
+		check_one_permit(s, label);
+		report(ctx, label, 1, samples, (size_t)ctx->samples);
+
+		// Samples are the time spent past the deadline.
+		snprintf(label, sizeof label, "timeout/wait/%s",
+				timeout_backends[b].label);
+		for (int i = 0; i < ctx->samples; i++) {
+			long long start = monotonic_ns();
+			if (sema_wait_timeout(s, TIMEOUT_NS) != SEMA_TIMED_OUT) {
+				printf_error("%s: acquired an empty semaphore", label);
+				exit(1);
+			}
+			samples[i] = monotonic_ns() - start - TIMEOUT_NS;
+		}
+		check_one_permit(s, label);
+		report(ctx, label, 1, samples, (size_t)ctx->samples);
+		sema_destroy(s);
+	}
+	sema_set_backend(saved);
+	free(samples);
+	return NULL;
+}
+
+// Measures a failed 'sema_try_wait' and how late a 'sema_wait_timeout' on an
+// empty semaphore returns, with each backend. Afterwards, checks that neither
+// took a permit or left a waiter behind.
+static void timeout(const struct BenchContext *ctx) {
+	pthread_t thread;
+	start_threads(ctx, &thread, 1, run_timeout, (void *)ctx, 0);
+	join_threads(&thread, 1);
+}
+
+const struct Benchmark bench_timeout = {
+	.name = "timeout",
+	.description = "Failed try_wait and timed-out wait with each backend",
+	.run = timeout
+};
+
+// Shared state for the fan-out benchmark.
+struct Fanout {
+	Semaphore gate;
+	Semaphore done;
+	Semaphore next;
+	int waiters;
+	int rounds;
+	bool batched;          // release with 'sema_signal_n'
+	int permits;           // permits each waiter takes with 'sema_wait_n'
+	long long *wake_times; // wake time of each waiter in the current round
+	long long *samples;
+};
+
+// Argument for a fan-out thread: index 0 releases, the rest wait.
+struct FanoutArg {
+	struct Fanout *shared;
+	int index;
+};
+
+static void *run_fanout(void *ptr) {
+	struct FanoutArg *arg = ptr;
+	struct Fanout *f = arg->shared;
+	for (int i = 0; i < f->rounds; i++) {
+		if (arg->index != 0) {
+			sema_wait_n(f->gate, f->permits);
+			f->wake_times[arg->index - 1] = monotonic_ns();
+			sema_signal(f->done);
+			// Don't race back to the gate and take another thread's permit.
+			sema_wait(f->next);
+			continue;
+		}
+		// Wait until every waiter is parked, so we measure real wakeups.
+		while (atomic_load(&f->gate->waiters) < f->waiters) {
+			sched_yield();
+		}
+		long long start = monotonic_ns();
+		if (f->batched) {
+			sema_signal_n(f->gate, f->waiters * f->permits);
+		} else {
+			for (int j = 0; j < f->waiters; j++) {
+				sema_signal(f->gate);
+			}
+		}
+		sema_wait_n(f->done, f->waiters);
+		sema_signal_n(f->next, f->waiters);
+		long long last = start;
+		for (int j = 0; j < f->waiters; j++) {
+			last = MAX(last, f->wake_times[j]);
+		}
+		if (i >= WARMUP) {
+			f->samples[i - WARMUP] = last - start;
+		}
+	}
+	return NULL;
+}
+
+// Labels and settings of the fan-out measurements. The last one has several
+// bulk waiters woken by one 'sema_signal_n'.
+static const struct {
+	const char *label;
+	bool batched;
+	int permits;
+} fanout_modes[] = {
+	{ "fanout/signal", false, 1 },
+	{ "fanout/signal_n", true, 1 },
+	{ "fanout/wait_n", true, 2 }
+};
+
+// Measures the time from releasing N-1 parked threads until the last one runs,
+// with a loop of signals, with one batched signal, and with one batched signal
+// to threads that each wait for two permits. Afterwards, checks that no permits
+// were lost or left over.
+static void fanout(const struct BenchContext *ctx) {
+	for (size_t m = 0; m < sizeof fanout_modes / sizeof fanout_modes[0]; m++) {
+		bool batched = fanout_modes[m].batched;
+		int n_threads = ctx->max_threads;
+		struct Fanout f = {
+			.gate = sema_create(0, true),
+			.done = sema_create(0, true),
+			.next = sema_create(0, true),
+			.waiters = n_threads - 1,
+			.rounds = ctx->samples + WARMUP,
+			.batched = batched,
+			.permits = fanout_modes[m].permits
+		};
+		f.wake_times = malloc((size_t)f.waiters * sizeof *f.wake_times);
+		f.samples = malloc((size_t)ctx->samples * sizeof *f.samples);
+		struct FanoutArg *args = malloc((size_t)n_threads * sizeof *args);
+		pthread_t *threads = malloc((size_t)n_threads * sizeof *threads);
+		for (int i = 0; i < n_threads; i++) {
+			args[i] = (struct FanoutArg){ &f, i };
+		}
+		start_threads(ctx, threads, n_threads, run_fanout, args, sizeof *args);
+		join_threads(threads, n_threads);
+
+		report(ctx, fanout_modes[m].label, n_threads, f.samples,
+				(size_t)ctx->samples);
+		int left = atomic_load(&f.gate->value);
+		if (left != 0) {
+			printf_error("%s: %d permits left over", fanout_modes[m].label,
+					left);
+			exit(1);
+		}
+		sema_destroy(f.gate);
+		sema_destroy(f.done);
+		sema_destroy(f.next);
+		free(f.wake_times);
+		free(f.samples);
+		free(args);
+		free(threads);
+	}
+}
+
+const struct Benchmark bench_fanout = {
+	.name = "fanout",
+	.description = "Time to wake all of N-1 parked threads",
+	.run = fanout
+};
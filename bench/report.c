@@ -0,0 +1,56 @@
+// Copyright 2016 Mitchell Kember. Subject to the MIT License.
+
+#include "bench.h"
+
+#include "topology.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Compares two long longs for 'qsort'.
+static int compare_ll(const void *a, const void *b) {
+	long long x = *(const long long *)a;
+	long long y = *(const long long *)b;
+	return (x > y) - (x < y);
+}
+
+// Returns the 'p' quantile (between 0 and 1) of the sorted samples.
+static long long quantile(const long long *sorted, size_t n, double p) {
+	size_t i = (size_t)(p * (double)n);
+	return sorted[i < n ? i : n - 1];
+}
+
+void print_report_header(void) {
+	printf("%-32s %-8s %7s %9s %9s %9s %9s\n",
+			"Benchmark", "Where", "Threads", "Min", "Median", "p99", "p99.9");
+	printf("%-32s %-8s %7s %9s %9s %9s %9s\n",
+			"================================", "========", "=======",
+			"=========", "=========", "=========", "=========");
+}
+
+void report(const struct BenchContext *ctx, const char *label, int threads,
+		long long *samples, size_t n) {
+	qsort(samples, n, sizeof *samples, compare_ll);
+	printf("%-32s %-8s %7d %9lld %9lld %9lld %9lld\n",
+			label, ctx->where, threads, samples[0],
+			quantile(samples, n, 0.5), quantile(samples, n, 0.99),
+			quantile(samples, n, 0.999));
+	fflush(stdout);
+}
+
+void start_threads(const struct BenchContext *ctx, pthread_t *threads, int n,
+		void *(*fn)(void *), void *args, size_t arg_size) {
+	for (int i = 0; i < n; i++) {
+		pthread_create(&threads[i], NULL, fn, (char *)args + i * arg_size);
+		int cpu = ctx->cpus[i % ctx->n_cpus];
+		if (cpu >= 0) {
+			pin_thread(threads[i], &cpu, 1);
+		}
+	}
+}
+
+void join_threads(pthread_t *threads, int n) {
+	for (int i = 0; i < n; i++) {
+		pthread_join(threads[i], NULL);
+	}
+}
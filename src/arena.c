@@ -0,0 +1,158 @@
+// Copyright 2016 Mitchell Kember. Subject to the MIT License.
+
+#include "arena.h"
+
+#include "util.h"
+
+#include <pthread.h>
+#include <stdalign.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Minimum size of an arena block, in bytes.
+#define MIN_BLOCK_SIZE 4096
+
+// A block of arena memory. Blocks form a list with the newest first.
+struct ArenaBlock {
+	struct ArenaBlock *next;
+	size_t size;
+	size_t used;
+	alignas(CACHE_LINE_SIZE) unsigned char data[];
+};
+
+// An arena. The mutex guards the blocks and counts, since role threads that
+// share the arena allocate from it at the same time.
+struct Arena {
+	pthread_mutex_t mutex;
+	struct ArenaBlock *blocks;
+	struct AllocCounts counts;
+};
+
+// The arena owned by the calling thread, which is only in use between
+// 'arena_begin' and 'arena_end'.
+static _Thread_local struct Arena own = {
+	PTHREAD_MUTEX_INITIALIZER, NULL, { 0, 0 }
+};
+
+// The arena the calling thread allocates from, or null for the heap.
+static _Thread_local struct Arena *current = NULL;
+
+// Rounds 'n' up to a multiple of the cache line size.
+static size_t round_up(size_t n) {
+	return (n + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+}
+
+// Allocates 'size' bytes aligned to a cache line from the heap, or exits.
+static void *heap_alloc(size_t size) {
+	void *p = aligned_alloc(CACHE_LINE_SIZE, size);
+	if (p == NULL) {
+		printf_error("out of memory");
+		exit(1);
+	}
+	return p;
+}
+
+// Adds a block with room for at least 'size' bytes to the front of the list.
+static void add_block(struct Arena *a, size_t size) {
+	size = MAX(round_up(size), MIN_BLOCK_SIZE);
+	struct ArenaBlock *b = heap_alloc(sizeof *b + size);
+	b->next = a->blocks;
+	b->size = size;
+	b->used = 0;
+	a->blocks = b;
+	a->counts.heap++;
+}
+
+// Frees all of the arena's blocks.
+static void free_blocks(struct Arena *a) {
+	while (a->blocks) {
+		struct ArenaBlock *next = a->blocks->next;
+		free(a->blocks);
+		a->blocks = next;
+	}
+}
+
+void arena_begin(void) {
+	own.counts = (struct AllocCounts){ 0, 0 };
+	current = &own;
+}
+
+void arena_reset(void) {
+	struct Arena *a = current;
+	if (a == NULL || a->blocks == NULL) {
+		return;
+	}
+	if (a->blocks->next == NULL) {
+		a->blocks->used = 0;
+		return;
+	}
+	size_t total = 0;
+	for (struct ArenaBlock *b = a->blocks; b; b = b->next) {
+		total += b->size;
+	}
+	free_blocks(a);
+	add_block(a, total);
+}
+
+void arena_end(void) {
+	free_blocks(&own);
+	current = NULL;
+}
+
+struct Arena *arena_current(void) {
+	return current;
+}
+
+void arena_share(struct Arena *arena) {
+	current = arena;
+}
+
+void *arena_alloc(size_t size, bool *in_arena) {
+	struct Arena *a = current;
+	*in_arena = a != NULL;
+	size = round_up(size);
+	if (a == NULL) {
+		return heap_alloc(size);
+	}
+	pthread_mutex_lock(&a->mutex);
+	if (a->blocks == NULL || a->blocks->size - a->blocks->used < size) {
+		add_block(a, size);
+	}
+	void *p = a->blocks->data + a->blocks->used;
+	a->blocks->used += size;
+	a->counts.arena++;
+	pthread_mutex_unlock(&a->mutex);
+	return p;
+}
+
+void *arena_calloc(size_t n, size_t size, bool *in_arena) {
+	void *p = arena_alloc(n * size, in_arena);
+	memset(p, 0, n * size);
+	return p;
+}
+
+void arena_free(void *ptr, bool in_arena) {
+	if (!in_arena) {
+		free(ptr);
+	}
+}
+
+void arena_count_heap(void) {
+	struct Arena *a = current;
+	if (a != NULL) {
+		pthread_mutex_lock(&a->mutex);
+		a->counts.heap++;
+		pthread_mutex_unlock(&a->mutex);
+	}
+}
+
+struct AllocCounts arena_counts(void) {
+	struct Arena *a = current;
+	if (a == NULL) {
+		return (struct AllocCounts){ 0, 0 };
+	}
+	pthread_mutex_lock(&a->mutex);
+	struct AllocCounts counts = a->counts;
+	pthread_mutex_unlock(&a->mutex);
+	return counts;
+}
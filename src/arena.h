@@ -0,0 +1,61 @@
+// Copyright 2016 Mitchell Kember. Subject to the MIT License.
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// An arena of memory that is reset between iterations, defined in arena.c.
+struct Arena;
+
+// Numbers of allocations made by the threads using one arena.
+struct AllocCounts {
+	unsigned long arena;  // served by bumping a pointer in the arena
+	unsigned long heap;   // from the heap, including growing the arena
+};
+
+// Gives the calling thread an arena. Until 'arena_end', 'arena_alloc' on this
+// thread (and on threads sharing it through 'arena_share') takes memory from
+// it, and frees become no-ops. Its allocation counts start at zero.
+void arena_begin(void);
+
+// Discards everything allocated from the calling thread's arena, keeping its
+// memory for reuse. If the arena had to grow, it is merged into one block big
+// enough for next time, so a repeated workload stops touching the heap. No
+// other thread may be using the arena.
+void arena_reset(void);
+
+// Frees the calling thread's arena.
+void arena_end(void);
+
+// Returns the calling thread's arena, or null if it does not have one.
+struct Arena *arena_current(void);
+
+// Makes 'arena_alloc' on the calling thread use 'arena' (a value returned by
+// 'arena_current' on another thread), or the heap if it is null. Role threads
+// use this so that a problem's memory all comes from the arena of the thread
+// running the problem. Allocating from a shared arena takes its lock.
+void arena_share(struct Arena *arena);
+
+// Allocates 'size' bytes aligned to a cache line, from the calling thread's
+// arena if it has one, or else from the heap. Sets '*in_arena' to say which,
+// for passing to 'arena_free'. Exits if there is no memory.
+void *arena_alloc(size_t size, bool *in_arena);
+
+// Like 'arena_alloc', but allocates 'n' zeroed elements of 'size' bytes.
+void *arena_calloc(size_t n, size_t size, bool *in_arena);
+
+// Frees memory from 'arena_alloc'. Memory in an arena is only reclaimed by
+// 'arena_reset' or 'arena_end'.
+void arena_free(void *ptr, bool in_arena);
+
+// Counts a heap allocation made without 'arena_alloc' (such as a registry
+// entry or a buffer segment) against the calling thread's arena, if any.
+void arena_count_heap(void);
+
+// Returns the allocation counts of the calling thread's arena so far, or zeros
+// if it does not have one.
+struct AllocCounts arena_counts(void);
+
+#endif
@@ -2,59 +2,462 @@
 
 #include "buffer.h"
 
+#include "arena.h"
 #include "semaphore.h"
+#include "util.h"
 
 #include <assert.h>
+#include <stdalign.h>
 #include <stdlib.h>
 #include <string.h>
 
 #define ERROR_BYTE 0xEE
 
+// Layout of a segmented buffer: the directory points to pages, pages point to
+// segments, and segments hold the bytes. These multiply to BUF_SEGMENTED_CAP.
+#define SEGMENT_SIZE ((size_t)1 << 16)
+#define SEGMENTS_PER_PAGE ((size_t)1 << 10)
+#define DIRECTORY_PAGES ((size_t)1 << 10)
+
+static_assert(SEGMENT_SIZE * SEGMENTS_PER_PAGE * DIRECTORY_PAGES
+		== BUF_SEGMENTED_CAP, "segmented buffer layout must match capacity");
+
+// A page of segment pointers.
+struct SegmentPage {
+	_Atomic(unsigned char *) segments[SEGMENTS_PER_PAGE];
+};
+
+// Header of a page or segment. Each buffer links its allocations into a list,
+// so that freeing it only visits the ones it made.
+struct SegmentAlloc {
+	struct SegmentAlloc *next;
+	alignas(max_align_t) unsigned char bytes[];
+};
+
+// Exits if an allocation failed.
+static void *check_alloc(void *ptr) {
+	if (ptr == NULL) {
+		printf_error("out of memory for buffer");
+		exit(1);
+	}
+	arena_count_heap();
+	return ptr;
+}
+
+// Number of events in a thread's first chunk of a buffer. Each further chunk
+// holds twice as many as the one before.
+#define FIRST_CHUNK_EVENTS 64
+
+// Part of a thread's private list of events. It starts on a cache line of its
+// own, and is allocated by the thread that uses it (from the arena it shares,
+// if any).
+struct BufferChunk {
+	alignas(CACHE_LINE_SIZE) struct BufferChunk *next;
+	bool in_arena;         // allocated from an arena
+	size_t first;          // number of events the thread pushed before these
+	atomic_size_t len;     // events written, published with a release store
+	size_t cap;
+	struct BufferEvent events[];
+};
+
+// An event's sort order: by timestamp, and then by sequence number for events
+// with equal timestamps.
+struct SortKey {
+	long long time;
+	unsigned long seq;
+	const struct BufferEvent *event;
+};
+
+// Source of buffer identifiers.
+static atomic_ulong next_id = 1;
+
+// The chunk that the calling thread used most recently, and the identifier of
+// the buffer it belongs to. Threads in a problem normally push to only one log.
+static _Thread_local unsigned long cached_id = 0;
+static _Thread_local struct BufferChunk *cached_chunk = NULL;
+
+// Scope of buffers created by this thread.
+static _Thread_local int buf_scope = 0;
+
+// Whether new buffers in per-thread mode are added to the list of logs, and
+// the list itself.
+static bool watch_enabled = false;
+static struct Buffer *logs_head = NULL;
+static pthread_mutex_t logs_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 void buf_init(struct Buffer *buf, size_t cap) {
-	buf->arr = malloc(cap);
-	buf->len = 0;
+	buf->arr = arena_alloc(cap, &buf->in_arena);
+	buf->directory = NULL;
+	atomic_init(&buf->allocs, NULL);
+	atomic_init(&buf->len, 0);
+	atomic_init(&buf->seq, 0);
 	buf->cap = cap;
 	buf->mutex = (pthread_mutex_t)PTHREAD_MUTEX_INITIALIZER;
+	buf->mode = BUF_LOCKED;
+	buf->id = atomic_fetch_add(&next_id, 1);
+	buf->chunks = NULL;
+	buf->times = NULL;
+	buf->times_in_arena = false;
+	buf->scope = buf_scope;
+	buf->watched = false;
+	buf->next_log = NULL;
+}
+
+void buf_init_log(struct Buffer *buf, size_t cap) {
+	buf_init(buf, cap);
+	buf->mode = BUF_APPEND;
+}
+
+void buf_init_events(struct Buffer *buf, size_t cap) {
+	buf_init(buf, cap);
+	buf->mode = BUF_PER_THREAD;
+	if (watch_enabled) {
+		pthread_mutex_lock(&logs_mutex);
+		buf->next_log = logs_head;
+		logs_head = buf;
+		buf->watched = true;
+		pthread_mutex_unlock(&logs_mutex);
+	}
+}
+
+void buf_init_segmented(struct Buffer *buf, enum BufferMode mode) {
+	buf_init(buf, 0);
+	buf->cap = BUF_SEGMENTED_CAP;
+	buf->mode = mode;
+	buf->directory =
+		check_alloc(calloc(DIRECTORY_PAGES, sizeof *buf->directory));
+}
+
+// Frees all the pages and segments of a segmented buffer in one pass over its
+// list of allocations, along with its index.
+static void free_segments(struct Buffer *buf) {
+	if (buf->directory == NULL) {
+		return;
+	}
+	struct SegmentAlloc *a = atomic_load(&buf->allocs);
+	while (a) {
+		struct SegmentAlloc *next = a->next;
+		free(a);
+		a = next;
+	}
+	atomic_store(&buf->allocs, NULL);
+	free(buf->directory);
+	buf->directory = NULL;
+}
+
+// Loads the pointer at 'ptr', first setting it to a new zeroed allocation of
+// 'size' bytes if it is null. Threads racing to do this agree on one winner,
+// which adds the allocation to the buffer's list.
+static void *load_or_create(struct Buffer *buf, _Atomic(void *) *ptr,
+		size_t size) {
+	void *p = atomic_load_explicit(ptr, memory_order_acquire);
+	if (p == NULL) {
+		struct SegmentAlloc *a = check_alloc(calloc(1, sizeof *a + size));
+		if (atomic_compare_exchange_strong_explicit(ptr, &p, a->bytes,
+				memory_order_acq_rel, memory_order_acquire)) {
+			p = a->bytes;
+			a->next = atomic_load_explicit(&buf->allocs, memory_order_relaxed);
+			while (!atomic_compare_exchange_weak_explicit(&buf->allocs,
+					&a->next, a, memory_order_relaxed, memory_order_relaxed));
+		} else {
+			free(a);
+		}
+	}
+	return p;
+}
+
+// Returns a pointer to the byte at index 'i' for writing. In a segmented
+// buffer, this creates the segment if it does not exist yet.
+static unsigned char *slot(struct Buffer *buf, size_t i) {
+	if (buf->directory == NULL) {
+		return &buf->arr[i];
+	}
+	size_t segment = i / SEGMENT_SIZE;
+	struct SegmentPage *page = load_or_create(buf,
+			(_Atomic(void *) *)&buf->directory[segment / SEGMENTS_PER_PAGE],
+			sizeof *page);
+	unsigned char *bytes = load_or_create(buf,
+			(_Atomic(void *) *)&page->segments[segment % SEGMENTS_PER_PAGE],
+			SEGMENT_SIZE);
+	return &bytes[i % SEGMENT_SIZE];
+}
+
+// Reads the byte at index 'i'. In a segmented buffer, bytes in segments that
+// were never written read as zero, without creating the segment.
+static unsigned char read_slot(struct Buffer *buf, size_t i) {
+	if (buf->directory == NULL) {
+		return buf->arr[i];
+	}
+	size_t segment = i / SEGMENT_SIZE;
+	struct SegmentPage *page = atomic_load_explicit(
+			&buf->directory[segment / SEGMENTS_PER_PAGE], memory_order_acquire);
+	if (page == NULL) {
+		return 0;
+	}
+	unsigned char *bytes = atomic_load_explicit(
+			&page->segments[segment % SEGMENTS_PER_PAGE], memory_order_acquire);
+	return bytes ? bytes[i % SEGMENT_SIZE] : 0;
+}
+
+// Frees the chunks of a buffer in per-thread mode.
+static void free_chunks(struct Buffer *buf) {
+	struct BufferChunk *c = buf->chunks;
+	while (c) {
+		struct BufferChunk *next = c->next;
+		arena_free(c, c->in_arena);
+		c = next;
+	}
+	buf->chunks = NULL;
 }
 
 void buf_free(struct Buffer *buf) {
-	free(buf->arr);
+	if (buf->watched) {
+		pthread_mutex_lock(&logs_mutex);
+		struct Buffer **p = &logs_head;
+		while (*p != buf) {
+			p = &(*p)->next_log;
+		}
+		*p = buf->next_log;
+		buf->watched = false;
+		pthread_mutex_unlock(&logs_mutex);
+	}
+	free_chunks(buf);
+	free_segments(buf);
+	if (buf->times) {
+		arena_free(buf->times, buf->times_in_arena);
+	}
+	arena_free(buf->arr, buf->in_arena);
+	buf->times = NULL;
 	buf->arr = NULL;
 }
 
+static int compare_keys(const void *lhs, const void *rhs) {
+	const struct SortKey *a = lhs;
+	const struct SortKey *b = rhs;
+	if (a->time != b->time) {
+		return a->time < b->time ? -1 : 1;
+	}
+	return a->seq < b->seq ? -1 : a->seq > b->seq;
+}
+
+// Returns the events in the chunks of a buffer in per-thread mode sorted by
+// time, as an array of 'n' keys that the caller must free with 'arena_free',
+// passing the value stored in '*in_arena'.
+static struct SortKey *sort_events(struct Buffer *buf, size_t *n,
+		bool *in_arena) {
+	*n = 0;
+	for (struct BufferChunk *c = buf->chunks; c; c = c->next) {
+		*n += atomic_load_explicit(&c->len, memory_order_acquire);
+	}
+	struct SortKey *keys = arena_alloc(MAX(*n, 1) * sizeof *keys, in_arena);
+	size_t k = 0;
+	for (struct BufferChunk *c = buf->chunks; c; c = c->next) {
+		// Owners may still be pushing (when called from 'buf_tail'), so only
+		// read the events published by the acquire load.
+		size_t len = atomic_load_explicit(&c->len, memory_order_acquire);
+		for (size_t i = 0; i < len && k < *n; i++) {
+			keys[k++] = (struct SortKey){
+				c->events[i].time, c->events[i].seq, &c->events[i]
+			};
+		}
+	}
+	*n = k;
+	qsort(keys, k, sizeof *keys, compare_keys);
+	return keys;
+}
+
+// Merges the chunks of a buffer in per-thread mode into 'arr' and 'times' in
+// timestamp order, the first time it is read. Events past the capacity are
+// dropped, just like pushes to a full buffer in the other modes. Holds the
+// mutex so that 'buf_tail' does not see the chunks being freed.
+static void merge(struct Buffer *buf) {
+	if (buf->mode != BUF_PER_THREAD || buf->times != NULL) {
+		return;
+	}
+	pthread_mutex_lock(&buf->mutex);
+	size_t n;
+	bool keys_in_arena;
+	struct SortKey *keys = sort_events(buf, &n, &keys_in_arena);
+	size_t bytes = 0;
+	for (size_t i = 0; i < n; i++) {
+		bytes += keys[i].event->len;
+	}
+	buf->times = arena_alloc(MAX(MIN(bytes, buf->cap), 1)
+			* sizeof *buf->times, &buf->times_in_arena);
+	size_t len = 0;
+	for (size_t i = 0; i < n; i++) {
+		const struct BufferEvent *e = keys[i].event;
+		for (size_t j = 0; j < e->len && len < buf->cap; j++) {
+			*slot(buf, len) = e->bytes[j];
+			buf->times[len] = e->time;
+			len++;
+		}
+	}
+	atomic_store_explicit(&buf->len, len, memory_order_relaxed);
+	arena_free(keys, keys_in_arena);
+	free_chunks(buf);
+	pthread_mutex_unlock(&buf->mutex);
+}
+
+size_t buf_len(struct Buffer *buf) {
+	merge(buf);
+	return MIN(atomic_load(&buf->len), buf->cap);
+}
+
+long long buf_time(struct Buffer *buf, size_t i) {
+	assert(buf->mode == BUF_PER_THREAD);
+	merge(buf);
+	assert(i < buf_len(buf));
+	return buf->times[i];
+}
+
 unsigned char buf_read(struct Buffer *buf, size_t i) {
+	if (buf->mode != BUF_LOCKED) {
+		merge(buf);
+		assert(i < buf->cap);
+		return read_slot(buf, i);
+	}
 	unsigned char c;
 	pthread_mutex_lock(&buf->mutex);
 	assert(i < buf->cap);
-	c = buf->arr[i];
+	c = read_slot(buf, i);
+	pthread_mutex_unlock(&buf->mutex);
+	return c;
+}
+
+// Reserves 'n' slots in an append-mode buffer, returning the index of the
+// first. Slots at or past the capacity must not be written.
+static size_t reserve(struct Buffer *buf, size_t n) {
+	return atomic_fetch_add_explicit(&buf->len, n, memory_order_relaxed);
+}
+
+// Returns the calling thread's chunk of a buffer in per-thread mode with room
+// for another event, or null if the thread has pushed enough to fill the whole
+// buffer. Only creating a chunk takes the mutex.
+static struct BufferChunk *own_chunk(struct Buffer *buf) {
+	struct BufferChunk *c = cached_id == buf->id ? cached_chunk : NULL;
+	size_t len = c ? atomic_load_explicit(&c->len, memory_order_relaxed) : 0;
+	if (c && len < c->cap) {
+		return c;
+	}
+	size_t first = c ? c->first + len : 0;
+	if (first >= buf->cap) {
+		return NULL;
+	}
+	size_t cap = c ? c->cap * 2 : FIRST_CHUNK_EVENTS;
+	cap = MIN(cap, buf->cap - first);
+	size_t size = sizeof *c + cap * sizeof c->events[0];
+	bool in_arena;
+	c = arena_alloc(size, &in_arena);
+	c->in_arena = in_arena;
+	c->first = first;
+	atomic_init(&c->len, 0);
+	c->cap = cap;
+	pthread_mutex_lock(&buf->mutex);
+	c->next = buf->chunks;
+	buf->chunks = c;
 	pthread_mutex_unlock(&buf->mutex);
+	cached_id = buf->id;
+	cached_chunk = c;
 	return c;
 }
 
+// Pushes 'n' bytes as one event with the current time to the calling thread's
+// chunk of a buffer in per-thread mode. The event is written before it is
+// counted in the chunk's length, so that 'buf_tail' never sees it half done.
+// Its sequence number comes from the buffer's counter: pushes ordered by other
+// synchronization (like a mutex handoff) take increasing numbers, so they stay
+// in order even if the clock gives them the same timestamp.
+static void push_event(struct Buffer *buf, const unsigned char *bytes,
+		unsigned char n) {
+	struct BufferChunk *c = own_chunk(buf);
+	if (c) {
+		size_t len = atomic_load_explicit(&c->len, memory_order_relaxed);
+		struct BufferEvent *e = &c->events[len];
+		e->time = monotonic_ns();
+		e->seq = atomic_fetch_add_explicit(&buf->seq, 1, memory_order_relaxed);
+		e->len = n;
+		memcpy(e->bytes, bytes, n);
+		atomic_store_explicit(&c->len, len + 1, memory_order_release);
+	}
+}
+
+// Returns the length of a buffer whose mutex is held.
+static size_t locked_len(struct Buffer *buf) {
+	return atomic_load_explicit(&buf->len, memory_order_relaxed);
+}
+
+// Sets the length of a buffer whose mutex is held.
+static void set_locked_len(struct Buffer *buf, size_t len) {
+	atomic_store_explicit(&buf->len, len, memory_order_relaxed);
+}
+
 void buf_push(struct Buffer *buf, unsigned char c) {
+	if (buf->mode == BUF_PER_THREAD) {
+		push_event(buf, &c, 1);
+		return;
+	}
+	if (buf->mode == BUF_APPEND) {
+		size_t i = reserve(buf, 1);
+		if (i < buf->cap) {
+			*slot(buf, i) = c;
+		}
+		return;
+	}
 	pthread_mutex_lock(&buf->mutex);
-	if (buf->len < buf->cap) {
-		buf->arr[buf->len++] = c;
+	size_t len = locked_len(buf);
+	if (len < buf->cap) {
+		*slot(buf, len++) = c;
 	}
+	set_locked_len(buf, len);
 	pthread_mutex_unlock(&buf->mutex);
 }
 
-void buf_push2(struct Buffer *buf, unsigned char c1, unsigned char c2) {
-	pthread_mutex_lock(&buf->mutex);
-	if (buf->len < buf->cap) {
-		buf->arr[buf->len++] = c1;
+// Pushes 'n' bytes (at most BUF_MAX_EVENT) so that they are adjacent. If there
+// is not room for all of them, pushes as many as fit.
+static void push_bytes(struct Buffer *buf, const unsigned char *bytes,
+		size_t n) {
+	if (buf->mode == BUF_PER_THREAD) {
+		push_event(buf, bytes, (unsigned char)n);
+		return;
 	}
-	if (buf->len < buf->cap) {
-		buf->arr[buf->len++] = c2;
+	if (buf->mode == BUF_APPEND) {
+		size_t i = reserve(buf, n);
+		for (size_t j = 0; j < n && i + j < buf->cap; j++) {
+			*slot(buf, i + j) = bytes[j];
+		}
+		return;
+	}
+	pthread_mutex_lock(&buf->mutex);
+	size_t len = locked_len(buf);
+	for (size_t j = 0; j < n && len < buf->cap; j++) {
+		*slot(buf, len++) = bytes[j];
 	}
+	set_locked_len(buf, len);
 	pthread_mutex_unlock(&buf->mutex);
 }
 
+void buf_push2(struct Buffer *buf, unsigned char c1, unsigned char c2) {
+	push_bytes(buf, (unsigned char[]){ c1, c2 }, 2);
+}
+
+void buf_push_id(struct Buffer *buf, unsigned char c, unsigned id) {
+	assert(id <= BUF_MAX_ID);
+	push_bytes(buf, (unsigned char[]){ c, id >> 8, id & 0xff }, 3);
+}
+
+unsigned buf_read_id(struct Buffer *buf, size_t i) {
+	return (unsigned)buf_read(buf, i) << 8 | buf_read(buf, i + 1);
+}
+
 unsigned char buf_pop(struct Buffer *buf) {
+	assert(buf->mode == BUF_LOCKED);
 	pthread_mutex_lock(&buf->mutex);
 	unsigned char c;
-	if (buf->len > 0) {
-		c = buf->arr[--buf->len];
+	size_t len = locked_len(buf);
+	if (len > 0) {
+		c = read_slot(buf, --len);
+		set_locked_len(buf, len);
 	} else {
 		c = ERROR_BYTE;
 	}
@@ -63,13 +466,55 @@ unsigned char buf_pop(struct Buffer *buf) {
 }
 
 bool buf_eq(struct Buffer *buf, const char* s) {
-	return strlen(s) == buf->len &&
-		strncmp((const char *)buf->arr, s, buf->len) == 0;
+	size_t len = buf_len(buf);
+	return buf_range_eq(buf, 0, len, s);
 }
 
 bool buf_range_eq(struct Buffer *buf, size_t i, size_t j, const char* s) {
 	assert(i <= j);
 	assert(j <= buf->cap);
-	return strlen(s) == j - i &&
-		strncmp((const char *)(buf->arr + i), s, j - i) == 0;
+	merge(buf);
+	if (strlen(s) != j - i) {
+		return false;
+	}
+	for (size_t k = i; k < j; k++) {
+		if (read_slot(buf, k) != (unsigned char)s[k - i]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void buf_enable_watch(bool enable) {
+	watch_enabled = enable;
+}
+
+void buf_set_scope(int scope) {
+	buf_scope = scope;
+}
+
+void buf_visit_logs(int scope, void (*visit)(struct Buffer *, void *),
+		void *arg) {
+	pthread_mutex_lock(&logs_mutex);
+	for (struct Buffer *buf = logs_head; buf; buf = buf->next_log) {
+		if (buf->scope == scope) {
+			visit(buf, arg);
+		}
+	}
+	pthread_mutex_unlock(&logs_mutex);
+}
+
+size_t buf_tail(struct Buffer *buf, struct BufferEvent *out, size_t max) {
+	assert(buf->mode == BUF_PER_THREAD);
+	pthread_mutex_lock(&buf->mutex);
+	size_t n;
+	bool in_arena;
+	struct SortKey *keys = sort_events(buf, &n, &in_arena);
+	size_t first = n > max ? n - max : 0;
+	for (size_t i = first; i < n; i++) {
+		out[i - first] = *keys[i].event;
+	}
+	arena_free(keys, in_arena);
+	pthread_mutex_unlock(&buf->mutex);
+	return n - first;
 }
@@ -4,32 +4,118 @@
 #define BUFFER_H
 
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stddef.h>
 
-// Fixed-capacity dynamic-length thread-safe buffer data type.
+// Capacity of a segmented buffer, in bytes (64 GiB).
+#define BUF_SEGMENTED_CAP ((size_t)1 << 36)
+
+// Ways a buffer can handle concurrent pushes.
+enum BufferMode {
+	BUF_LOCKED,      // every operation takes the mutex
+	BUF_APPEND,      // pushes reserve space with one atomic add on 'len'
+	BUF_PER_THREAD   // each thread pushes to a chunk of its own
+};
+
+// Largest number of bytes pushed at once.
+#define BUF_MAX_EVENT 3
+
+// Largest number that can be pushed with 'buf_push_id'.
+#define BUF_MAX_ID 0xffff
+
+// One push to a buffer in per-thread mode.
+struct BufferEvent {
+	long long time;
+	unsigned long seq;  // order of the push among all pushes to the buffer
+	unsigned char len;
+	unsigned char bytes[BUF_MAX_EVENT];
+};
+
+// A thread's private part of a buffer in per-thread mode, defined in buffer.c.
+struct BufferChunk;
+
+// A page of the segment index of a segmented buffer, defined in buffer.c.
+struct SegmentPage;
+
+// A page or segment allocated by a segmented buffer, defined in buffer.c.
+struct SegmentAlloc;
+
+// Fixed-capacity dynamic-length thread-safe buffer data type. Normally every
+// operation takes the mutex. The other modes are for event logs, which can only
+// be read once the pushing threads are done. In append mode, 'len' may run past
+// 'cap' after an overflow, so use 'buf_len' to get the actual length. In
+// per-thread mode, every push is timestamped and numbered, and the first read
+// merges the chunks into one array ordered by time (and by number for equal
+// timestamps).
+//
+// A segmented buffer (in any mode) has no fixed capacity. Instead of one array,
+// it stores bytes in fixed-size segments that are allocated as the buffer
+// grows and never moved, and finds them through a two-level index.
 struct Buffer {
-	unsigned char *arr;
+	unsigned char *arr;                       // bytes, unless segmented
+	bool in_arena;                            // 'arr' is from an arena
+	_Atomic(struct SegmentPage *) *directory; // segment index, if segmented
+	_Atomic(struct SegmentAlloc *) allocs;    // its pages and segments
 	pthread_mutex_t mutex;
-	size_t len;
+	atomic_size_t len;
+	atomic_ulong seq;             // next event sequence number (per-thread)
 	size_t cap;
+	enum BufferMode mode;
+	unsigned long id;             // distinguishes buffers at the same address
+	struct BufferChunk *chunks;   // per-thread chunks not merged yet
+	long long *times;             // timestamp of each byte, once merged
+	bool times_in_arena;          // 'times' is from an arena
+	int scope;                    // scope of the thread that created it
+	bool watched;                 // in the list of logs for the watchdog
+	struct Buffer *next_log;      // next watched log
 };
 
 // Initializes the buffer with capacity 'cap' and zero length.
 void buf_init(struct Buffer *buf, size_t cap);
 
+// Like 'buf_init', but in append mode: 'buf_push' and 'buf_push2' are lock-free
+// and 'buf_pop' is not allowed.
+void buf_init_log(struct Buffer *buf, size_t cap);
+
+// Like 'buf_init', but in per-thread mode: after a thread's first push, pushes
+// only touch a shared sequence counter, and 'buf_pop' is not allowed.
+void buf_init_events(struct Buffer *buf, size_t cap);
+
+// Initializes a segmented buffer in the given mode with zero length. It can
+// grow to BUF_SEGMENTED_CAP bytes.
+void buf_init_segmented(struct Buffer *buf, enum BufferMode mode);
+
 // Frees the buffer's memory. Do not use after calling this.
 void buf_free(struct Buffer *buf);
 
+// Returns the number of bytes in the buffer.
+size_t buf_len(struct Buffer *buf);
+
 // Reads the byte in the buffer at index 'i'.
 unsigned char buf_read(struct Buffer *buf, size_t i);
 
-// Writes the character 'c' at index 'buf->len', and increments 'buf->len'.
+// Returns the monotonic time in nanoseconds when the byte at index 'i' was
+// pushed. The buffer must be in per-thread mode.
+long long buf_time(struct Buffer *buf, size_t i);
+
+// Writes the character 'c' at index 'buf->len', and increments 'buf->len'. Does
+// nothing if the buffer is full.
 void buf_push(struct Buffer *buf, unsigned char c);
 
-// Like 'buf_push2', but pushes two characters (atomically).
+// Like 'buf_push', but pushes two characters (atomically), so that they are
+// adjacent. If there is only room for one, pushes only the first.
 void buf_push2(struct Buffer *buf, unsigned char c1, unsigned char c2);
 
+// Like 'buf_push2', but pushes 'c' followed by 'id' as a two-byte number (most
+// significant byte first), for logs about more than 256 threads or items. The
+// 'id' must be at most BUF_MAX_ID.
+void buf_push_id(struct Buffer *buf, unsigned char c, unsigned id);
+
+// Reads the number pushed by 'buf_push_id' that starts at index 'i' (just after
+// its character).
+unsigned buf_read_id(struct Buffer *buf, size_t i);
+
 // Removes a character from the end of the buffer. Must be non-empty.
 unsigned char buf_pop(struct Buffer *buf);
 
@@ -41,4 +127,23 @@ bool buf_eq(struct Buffer *buf, const char* s);
 // (exclusive) are the same as the string 's'.
 bool buf_range_eq(struct Buffer *buf, size_t i, size_t j, const char* s);
 
+// Enables or disables keeping a list of the buffers in per-thread mode created
+// afterwards, for the deadlock watchdog.
+void buf_enable_watch(bool enable);
+
+// Sets the scope (the same as 'sema_set_watch_scope') of buffers created by the
+// calling thread.
+void buf_set_scope(int scope);
+
+// Calls 'visit(buf, arg)' for each watched buffer in 'scope'. The buffers
+// cannot be freed until it returns.
+void buf_visit_logs(int scope, void (*visit)(struct Buffer *, void *),
+		void *arg);
+
+// Copies the last (up to) 'max' events pushed to a buffer in per-thread mode
+// into 'out' in timestamp order, without merging the chunks, and returns the
+// number copied. Events being pushed at the same time may be missed, and once
+// the buffer has been read there are none left to copy.
+size_t buf_tail(struct Buffer *buf, struct BufferEvent *out, size_t max);
+
 #endif
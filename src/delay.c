@@ -0,0 +1,253 @@
+// Copyright 2016 Mitchell Kember. Subject to the MIT License.
+
+#include "delay.h"
+
+#include "util.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+// Maximum number of call sites that can be overridden.
+#define MAX_OVERRIDES 64
+
+// Maximum length of a delay specification.
+#define MAX_SPEC_LEN 128
+
+// Maximum delay duration, in microseconds.
+#define MAX_DELAY_US 1000000
+
+// Number of iterations timed to calibrate spinning.
+#define CALIBRATION_SPINS 100000
+
+// Names of the delay modes, indexed by 'enum DelayMode'.
+static const char *const mode_names[] = {
+	"sleep", "spin", "yield", "jitter", "none"
+};
+
+#define N_MODES (sizeof mode_names / sizeof mode_names[0])
+
+// Settings for one call site given by 'delay_configure'. Negative fields were
+// omitted and come from the default configuration.
+struct Override {
+	char file[MAX_SPEC_LEN];
+	int line;
+	int mode;
+	long long ns;
+	int percent;
+};
+
+// Configuration for call sites without an override.
+static struct DelayConfig default_config = { DELAY_SLEEP, 20000, 100 };
+
+// Call site overrides.
+static struct Override overrides[MAX_OVERRIDES];
+static int n_overrides = 0;
+
+// Serializes call sites looking up their configuration.
+static pthread_mutex_t resolve_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Number of 'cpu_relax' iterations per microsecond, measured on first use.
+static long long spins_per_us = 0;
+static pthread_once_t calibrate_once = PTHREAD_ONCE_INIT;
+
+// State of this thread's random number generator.
+static _Thread_local uint32_t random_state = 0;
+
+// Returns a pseudorandom number using a xorshift generator.
+static uint32_t next_random(void) {
+	uint32_t x = random_state;
+	if (x == 0) {
+		x = (uint32_t)(uintptr_t)&random_state ^ (uint32_t)monotonic_ns();
+		x |= 1;
+	}
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	random_state = x;
+	return x;
+}
+
+static void calibrate(void) {
+	long long start = monotonic_ns();
+	for (int i = 0; i < CALIBRATION_SPINS; i++) {
+		cpu_relax();
+	}
+	long long elapsed = MAX(1, monotonic_ns() - start);
+	spins_per_us = MAX(1, CALIBRATION_SPINS * 1000LL / elapsed);
+}
+
+static void spin_ns(long long ns) {
+	pthread_once(&calibrate_once, calibrate);
+	long long spins = ns * spins_per_us / 1000;
+	for (long long i = 0; i < spins; i++) {
+		cpu_relax();
+	}
+}
+
+static void sleep_ns(long long ns) {
+	struct timespec ts = {
+		.tv_sec = (time_t)(ns / 1000000000),
+		.tv_nsec = (long)(ns % 1000000000)
+	};
+	nanosleep(&ts, NULL);
+}
+
+// Looks up the configuration for a call site.
+static void resolve(struct DelaySite *site) {
+	pthread_mutex_lock(&resolve_mutex);
+	if (!atomic_load_explicit(&site->resolved, memory_order_relaxed)) {
+		const char *slash = strrchr(site->file, '/');
+		const char *base = slash ? slash + 1 : site->file;
+		struct DelayConfig config = default_config;
+		for (int i = 0; i < n_overrides; i++) {
+			const struct Override *o = &overrides[i];
+			if (o->line == site->line && strcmp(o->file, base) == 0) {
+				if (o->mode >= 0) {
+					config.mode = (enum DelayMode)o->mode;
+				}
+				if (o->ns >= 0) {
+					config.ns = o->ns;
+				}
+				if (o->percent >= 0) {
+					config.percent = o->percent;
+				}
+			}
+		}
+		site->config = config;
+		atomic_store_explicit(&site->resolved, true, memory_order_release);
+	}
+	pthread_mutex_unlock(&resolve_mutex);
+}
+
+void delay_at(struct DelaySite *site) {
+	if (!atomic_load_explicit(&site->resolved, memory_order_acquire)) {
+		resolve(site);
+	}
+	const struct DelayConfig *c = &site->config;
+	if (c->percent < 100 && (int)(next_random() % 100) >= c->percent) {
+		return;
+	}
+	switch (c->mode) {
+	case DELAY_SLEEP:
+		sleep_ns(c->ns);
+		break;
+	case DELAY_SPIN:
+		spin_ns(c->ns);
+		break;
+	case DELAY_YIELD:
+		sched_yield();
+		break;
+	case DELAY_JITTER:
+		sleep_ns((long long)(next_random() % (uint32_t)(c->ns + 1)));
+		break;
+	case DELAY_NONE:
+		break;
+	}
+}
+
+void increment_at(int *ptr, struct DelaySite *site) {
+	int val = *ptr;
+	delay_at(site);
+	*ptr = val + 1;
+}
+
+void decrement_at(int *ptr, struct DelaySite *site) {
+	int val = *ptr;
+	delay_at(site);
+	*ptr = val - 1;
+}
+
+// Parses the MODE[,US[,P]] part of a specification into 'o', leaving omitted
+// fields negative. Returns false on failure.
+static bool parse_config(struct Override *o, char *str) {
+	char *us = strchr(str, ',');
+	if (us) {
+		*us++ = '\0';
+	}
+	char *percent = us ? strchr(us, ',') : NULL;
+	if (percent) {
+		*percent++ = '\0';
+	}
+	o->mode = -1;
+	for (size_t i = 0; i < N_MODES; i++) {
+		if (strcmp(str, mode_names[i]) == 0) {
+			o->mode = (int)i;
+		}
+	}
+	if (o->mode < 0) {
+		printf_error("%s: unknown delay mode", str);
+		return false;
+	}
+	o->ns = -1;
+	if (us) {
+		int n;
+		if (!parse_int(&n, us)) {
+			return false;
+		}
+		if (n < 0 || n > MAX_DELAY_US) {
+			printf_error("%s: delay must be between 0 and %d us",
+					us, MAX_DELAY_US);
+			return false;
+		}
+		o->ns = n * 1000LL;
+	}
+	o->percent = -1;
+	if (percent) {
+		if (!parse_int(&o->percent, percent)) {
+			return false;
+		}
+		if (o->percent < 0 || o->percent > 100) {
+			printf_error("%s: probability must be between 0 and 100",
+					percent);
+			return false;
+		}
+	}
+	return true;
+}
+
+bool delay_configure(const char *spec) {
+	char buf[MAX_SPEC_LEN];
+	if (strlen(spec) >= sizeof buf) {
+		printf_error("%s: delay specification too long", spec);
+		return false;
+	}
+	strcpy(buf, spec);
+
+	char *config = strchr(buf, '=');
+	if (config == NULL) {
+		struct Override o;
+		if (!parse_config(&o, buf)) {
+			return false;
+		}
+		default_config.mode = (enum DelayMode)o.mode;
+		if (o.ns >= 0) {
+			default_config.ns = o.ns;
+		}
+		if (o.percent >= 0) {
+			default_config.percent = o.percent;
+		}
+		return true;
+	}
+
+	*config++ = '\0';
+	char *colon = strrchr(buf, ':');
+	if (colon == NULL) {
+		printf_error("%s: call site should be FILE:LINE", buf);
+		return false;
+	}
+	*colon = '\0';
+	if (n_overrides == MAX_OVERRIDES) {
+		printf_error("too many delay overrides (maximum %d)", MAX_OVERRIDES);
+		return false;
+	}
+	struct Override *o = &overrides[n_overrides];
+	if (!parse_int(&o->line, colon + 1) || !parse_config(o, config)) {
+		return false;
+	}
+	strcpy(o->file, buf);
+	n_overrides++;
+	return true;
+}
@@ -0,0 +1,71 @@
+// Copyright 2016 Mitchell Kember. Subject to the MIT License.
+
+#ifndef DELAY_H
+#define DELAY_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+
+// Ways 'delay' can perturb the calling thread.
+enum DelayMode {
+	DELAY_SLEEP,   // sleep for the duration
+	DELAY_SPIN,    // busy-wait for the duration, calibrated at startup
+	DELAY_YIELD,   // yield the processor once, ignoring the duration
+	DELAY_JITTER,  // sleep for a random time up to the duration
+	DELAY_NONE     // do nothing
+};
+
+// Settings for a delay: what to do, for how long, and how often.
+struct DelayConfig {
+	enum DelayMode mode;
+	long long ns;   // duration in nanoseconds
+	int percent;    // probability of delaying at all, from 0 to 100
+};
+
+// A call site of 'delay', 'increment', or 'decrement'. Each one is a static
+// variable created by the macros below, and looks up its configuration (the
+// global one, unless overridden for that file and line) the first time it runs.
+struct DelaySite {
+	const char *file;
+	int line;
+	atomic_bool resolved;
+	struct DelayConfig config;
+};
+
+#define DELAY_SITE_INIT { __FILE__, __LINE__, false, { DELAY_NONE, 0, 0 } }
+
+// Sleeps or otherwise perturbs the calling thread for a short time, according
+// to the configuration for the call site. Used to expose concurrency issues and
+// cause failures when semaphores are disabled.
+#define delay() do { \
+	static struct DelaySite delay_site_ = DELAY_SITE_INIT; \
+	delay_at(&delay_site_); \
+} while (0)
+
+// Increments the given integer, with a delay between reading and writing.
+#define increment(ptr) do { \
+	static struct DelaySite delay_site_ = DELAY_SITE_INIT; \
+	increment_at((ptr), &delay_site_); \
+} while (0)
+
+// Decrements the given integer, with a delay between reading and writing.
+#define decrement(ptr) do { \
+	static struct DelaySite delay_site_ = DELAY_SITE_INIT; \
+	decrement_at((ptr), &delay_site_); \
+} while (0)
+
+// Functions behind the macros above.
+void delay_at(struct DelaySite *site);
+void increment_at(int *ptr, struct DelaySite *site);
+void decrement_at(int *ptr, struct DelaySite *site);
+
+// Applies a delay specification, which has the form [FILE:LINE=]MODE[,US[,P]]:
+// the mode name (sleep, spin, yield, jitter, or none), the duration in
+// microseconds, and the probability in percent. Without FILE:LINE, it changes
+// the default for all call sites; otherwise, it overrides the one call site on
+// that line (FILE is the base name, like "problem_03.c"). Omitted fields keep
+// their defaults. Must be called before any delays happen. Prints an error
+// message and returns false if the specification is invalid.
+bool delay_configure(const char *spec);
+
+#endif
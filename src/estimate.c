@@ -0,0 +1,131 @@
+// Copyright 2016 Mitchell Kember. Subject to the MIT License.
+
+#include "estimate.h"
+
+#include "util.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+// Normal quantile for a two-sided 95% confidence interval.
+#define Z_95 1.959964
+
+// Largest half-width of the interval for 'estimate_precise'.
+#define MARGIN 0.05
+
+// Probability of seeing a failure that 'estimate_iterations' aims for.
+#define DETECTION 0.999
+
+// First line of an estimates file, naming the columns.
+#define FILE_HEADER "# problem trials failures"
+
+// Prefix of the second line of an estimates file, which holds the
+// configuration the estimates were made with.
+#define CONFIG_PREFIX "# config "
+
+void estimate_interval(struct Estimate e, double *low, double *high) {
+	if (e.trials == 0) {
+		*low = 0;
+		*high = 1;
+		return;
+	}
+	const double n = (double)e.trials;
+	const double p = (double)e.failures / n;
+	const double z2 = Z_95 * Z_95;
+	const double denom = 1 + z2 / n;
+	const double center = (p + z2 / (2 * n)) / denom;
+	const double half = Z_95 * sqrt(p * (1 - p) / n + z2 / (4 * n * n)) / denom;
+	*low = MAX(0.0, center - half);
+	*high = MIN(1.0, center + half);
+}
+
+bool estimate_precise(struct Estimate e) {
+	double low, high;
+	estimate_interval(e, &low, &high);
+	return high - low <= 2 * MARGIN;
+}
+
+long long estimate_iterations(struct Estimate e, long long max) {
+	double low, high;
+	estimate_interval(e, &low, &high);
+	if (low <= 0) {
+		return max;
+	}
+	if (low >= 1) {
+		return MIN(1, max);
+	}
+	double n = ceil(log(1 - DETECTION) / log(1 - low));
+	return n >= (double)max ? max : MAX(1, (long long)n);
+}
+
+bool estimates_load(const char *path, const char *config, struct Estimate *out,
+		int n) {
+	FILE *file = fopen(path, "r");
+	if (!file) {
+		printf_error("%s: %s", path, strerror(errno));
+		return false;
+	}
+	for (int i = 0; i < n; i++) {
+		out[i] = (struct Estimate){ 0, 0 };
+	}
+	const size_t prefix_len = strlen(CONFIG_PREFIX);
+	char line[512];
+	int line_number = 0;
+	bool ok = true;
+	bool matched = false;
+	while (ok && fgets(line, sizeof line, file)) {
+		line_number++;
+		if (strncmp(line, CONFIG_PREFIX, prefix_len) == 0) {
+			line[strcspn(line, "\n")] = '\0';
+			matched = strcmp(line + prefix_len, config) == 0;
+			if (!matched) {
+				printf_error("%s: estimates made with %s, not %s", path,
+						line + prefix_len, config);
+				ok = false;
+			}
+			continue;
+		}
+		if (line[0] == '#' || line[0] == '\n') {
+			continue;
+		}
+		if (!matched) {
+			printf_error("%s: no configuration before the estimates", path);
+			ok = false;
+			break;
+		}
+		int problem;
+		unsigned long trials, failures;
+		if (sscanf(line, "%d %lu %lu", &problem, &trials, &failures) != 3
+				|| problem < 1 || problem > n || failures > trials) {
+			printf_error("%s:%d: invalid estimate", path, line_number);
+			ok = false;
+			break;
+		}
+		out[problem - 1] = (struct Estimate){ trials, failures };
+	}
+	fclose(file);
+	return ok;
+}
+
+bool estimates_save(const char *path, const char *config,
+		const struct Estimate *estimates, int n) {
+	FILE *file = fopen(path, "w");
+	if (!file) {
+		printf_error("%s: %s", path, strerror(errno));
+		return false;
+	}
+	fprintf(file, "%s\n%s%s\n", FILE_HEADER, CONFIG_PREFIX, config);
+	for (int i = 0; i < n; i++) {
+		if (estimates[i].trials > 0) {
+			fprintf(file, "%d %lu %lu\n", i + 1, estimates[i].trials,
+					estimates[i].failures);
+		}
+	}
+	if (fclose(file) != 0) {
+		printf_error("%s: %s", path, strerror(errno));
+		return false;
+	}
+	return true;
+}
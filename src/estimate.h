@@ -0,0 +1,44 @@
+// Copyright 2016 Mitchell Kember. Subject to the MIT License.
+
+#ifndef ESTIMATE_H
+#define ESTIMATE_H
+
+#include <stdbool.h>
+
+// An estimate of how often an iteration of a negative test fails, from the
+// outcomes of the iterations run so far.
+struct Estimate {
+	unsigned long trials;    // iterations run
+	unsigned long failures;  // iterations that did not succeed
+};
+
+// Computes the 95% Wilson score interval for the failure rate, storing its
+// bounds in 'low' and 'high'. With no trials, the interval is [0, 1].
+void estimate_interval(struct Estimate e, double *low, double *high);
+
+// Returns true once the estimate is precise enough to stop: the interval is no
+// wider than 5 percentage points on either side.
+bool estimate_precise(struct Estimate e);
+
+// Returns the number of iterations of a negative test needed to see at least
+// one failure with 99.9% probability, taking the failure rate to be the lower
+// bound of the interval. Returns 'max' if that is more, or if the lower bound
+// is zero.
+long long estimate_iterations(struct Estimate e, long long max);
+
+// Loads the estimates for problems 1 to 'n' from the file at 'path' into
+// 'out', indexed by problem number minus one. Problems missing from the file
+// get no trials. The file must have been saved with the same 'config', since
+// failure rates depend on it. If there was an error, or the configuration does
+// not match, prints an error message and returns false.
+bool estimates_load(const char *path, const char *config, struct Estimate *out,
+		int n);
+
+// Saves the estimates for problems 1 to 'n' to the file at 'path', skipping
+// those with no trials. The header records 'config', a line describing the
+// settings the estimates were made with. If there was an error, prints an
+// error message and returns false.
+bool estimates_save(const char *path, const char *config,
+		const struct Estimate *estimates, int n);
+
+#endif
@@ -0,0 +1,92 @@
+// Copyright 2016 Mitchell Kember. Subject to the MIT License.
+
+#include "eventfd.h"
+
+#if defined(__linux__)
+
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+bool efd_supported(void) {
+	return true;
+}
+
+int efd_create(int value) {
+	return eventfd((unsigned)value, EFD_SEMAPHORE | EFD_NONBLOCK | EFD_CLOEXEC);
+}
+
+void efd_close(int fd) {
+	close(fd);
+}
+
+bool efd_take(int fd) {
+	uint64_t one;
+	ssize_t ret;
+	do {
+		ret = read(fd, &one, sizeof one);
+	} while (ret == -1 && errno == EINTR);
+	return ret == sizeof one;
+}
+
+void efd_give(int fd, int n) {
+	uint64_t count = (uint64_t)n;
+	ssize_t ret;
+	do {
+		ret = write(fd, &count, sizeof count);
+	} while (ret == -1 && errno == EINTR);
+}
+
+bool efd_poll(const int *fds, int n, long long timeout_ns) {
+	assert(n >= 1 && n <= EFD_POLL_MAX);
+	struct pollfd pfds[EFD_POLL_MAX];
+	for (int i = 0; i < n; i++) {
+		pfds[i] = (struct pollfd){ .fd = fds[i], .events = POLLIN };
+	}
+	// Round up to whole milliseconds so that short timeouts still block.
+	int timeout_ms = -1;
+	if (timeout_ns >= 0) {
+		long long ms = (timeout_ns + 999999) / 1000000;
+		timeout_ms = ms > INT_MAX ? INT_MAX : (int)ms;
+	}
+	int ret = poll(pfds, (nfds_t)n, timeout_ms);
+	return ret != 0;
+}
+
+#else
+
+bool efd_supported(void) {
+	return false;
+}
+
+int efd_create(int value) {
+	(void)value;
+	return -1;
+}
+
+void efd_close(int fd) {
+	(void)fd;
+}
+
+bool efd_take(int fd) {
+	(void)fd;
+	return false;
+}
+
+void efd_give(int fd, int n) {
+	(void)fd;
+	(void)n;
+}
+
+bool efd_poll(const int *fds, int n, long long timeout_ns) {
+	(void)fds;
+	(void)n;
+	(void)timeout_ns;
+	return false;
+}
+
+#endif
@@ -0,0 +1,33 @@
+// Copyright 2016 Mitchell Kember. Subject to the MIT License.
+
+#ifndef EVENTFD_H
+#define EVENTFD_H
+
+#include <stdbool.h>
+
+// Maximum number of descriptors 'efd_poll' can wait on at once.
+#define EFD_POLL_MAX 128
+
+// Returns true if eventfd semaphores are available on this platform.
+bool efd_supported(void);
+
+// Creates a nonblocking eventfd in semaphore mode with an initial value.
+// Returns the file descriptor, or -1 on failure.
+int efd_create(int value);
+
+// Closes an eventfd created by 'efd_create'.
+void efd_close(int fd);
+
+// Decrements the eventfd by one if it is positive. Returns true on success.
+bool efd_take(int fd);
+
+// Increments the eventfd by 'n', waking up any threads polling it.
+void efd_give(int fd, int n);
+
+// Blocks until at least one of the 'n' eventfds in 'fds' is readable, for at
+// most 'timeout_ns' nanoseconds (or indefinitely if it is negative). Another
+// thread may take the value first, so callers must retry 'efd_take' in a loop.
+// Returns false only if the timeout expired.
+bool efd_poll(const int *fds, int n, long long timeout_ns);
+
+#endif
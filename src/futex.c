@@ -0,0 +1,63 @@
+// Copyright 2016 Mitchell Kember. Subject to the MIT License.
+
+#include "futex.h"
+
+#if defined(__linux__)
+
+#include <errno.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+bool futex_wait(atomic_int *addr, int expected, long long timeout_ns) {
+	struct timespec ts;
+	struct timespec *timeout = NULL;
+	if (timeout_ns >= 0) {
+		ts.tv_sec = (time_t)(timeout_ns / 1000000000);
+		ts.tv_nsec = (long)(timeout_ns % 1000000000);
+		timeout = &ts;
+	}
+	long ret = syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, expected, timeout,
+			NULL, 0);
+	return !(ret == -1 && errno == ETIMEDOUT);
+}
+
+void futex_wake(atomic_int *addr, int count) {
+	syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+}
+
+#elif defined(__APPLE__)
+
+#include <errno.h>
+#include <stdint.h>
+
+// Private Darwin primitives underlying os_unfair_lock and libc++ atomic waits.
+// They have been stable since macOS 10.12.
+#define UL_COMPARE_AND_WAIT 1
+#define ULF_WAKE_ALL 0x00000100
+extern int __ulock_wait(
+		uint32_t operation, void *addr, uint64_t value, uint32_t timeout_us);
+extern int __ulock_wake(uint32_t operation, void *addr, uint64_t wake_value);
+
+bool futex_wait(atomic_int *addr, int expected, long long timeout_ns) {
+	// Zero means no timeout, so round up to at least one microsecond.
+	uint32_t timeout_us = 0;
+	if (timeout_ns >= 0) {
+		long long us = (timeout_ns + 999) / 1000;
+		timeout_us = us == 0 ? 1 : us > UINT32_MAX ? UINT32_MAX : (uint32_t)us;
+	}
+	int ret = __ulock_wait(UL_COMPARE_AND_WAIT, addr,
+			(uint64_t)(uint32_t)expected, timeout_us);
+	return !(ret == -1 && errno == ETIMEDOUT);
+}
+
+void futex_wake(atomic_int *addr, int count) {
+	// Darwin can only wake one thread or all of them.
+	uint32_t flags = count == 1 ? 0 : ULF_WAKE_ALL;
+	__ulock_wake(UL_COMPARE_AND_WAIT | flags, addr, 0);
+}
+
+#else
+#error "futex: unsupported platform"
+#endif
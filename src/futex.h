@@ -0,0 +1,19 @@
+// Copyright 2016 Mitchell Kember. Subject to the MIT License.
+
+#ifndef FUTEX_H
+#define FUTEX_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+
+// Blocks the calling thread as long as the 32-bit word at 'addr' is equal to
+// 'expected', for at most 'timeout_ns' nanoseconds (or indefinitely if it is
+// negative). Returns immediately if the word is not equal. This may also return
+// spuriously, so callers must always recheck their condition in a loop. Returns
+// false only if the timeout expired.
+bool futex_wait(atomic_int *addr, int expected, long long timeout_ns);
+
+// Wakes up to 'count' threads blocked in 'futex_wait' on 'addr'.
+void futex_wake(atomic_int *addr, int count);
+
+#endif
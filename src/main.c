@@ -1,9 +1,13 @@
 // Copyright 2016 Mitchell Kember. Subject to the MIT License.
 
+#include "delay.h"
 #include "problems.h"
+#include "semaphore.h"
 #include "test.h"
+#include "topology.h"
 #include "util.h"
 
+#include <getopt.h>
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
@@ -12,10 +16,17 @@
 #define DEFAULT_POS_ITERS 5
 #define DEFAULT_NEG_ITERS 5
 #define DEFAULT_JOBS 1
+#define DEFAULT_DEADLINE_S 60
+#define DEFAULT_WATCHDOG_MS 1000
+#define DEFAULT_ESTIMATE_S 10
 
 // Maximum values for some parameters.
-#define MAX_ITERS 10000
+#define MAX_ITERS 1000000000000LL
 #define MAX_JOBS 64
+#define MAX_SPIN 1000000
+#define MAX_WAIT_MS 3600000
+#define MAX_DEADLINE_S 86400
+#define MAX_DURATION_S 604800
 
 // Helper macros for stringification.
 #define S_(x) #x
@@ -36,19 +47,171 @@ static const char *const usage_message =
 	"    Use -p0 to disable positive tests and -n0 to disable negative tests\n"
 	"\n"
 	"  Other options\n"
-	"    -j N  Run N jobs in parallel\n"
+	"    -j N  Run N jobs in parallel (with -t, split its iterations)\n"
+	"    -s N  Spin up to N times in sema_wait before blocking (adaptive)\n"
+	"    -w N  Time out semaphore waits after N milliseconds (0 for never)\n"
+	"    -c    Collect semaphore contention statistics and print them\n"
+	"    -e    Use eventfd semaphores instead of futexes (Linux only)\n"
+	"    -f    Use strictly FIFO semaphores (handoff to the oldest waiter)\n"
+	"    -d D  Configure delays, where D is [FILE:LINE=]MODE[,US[,P]]\n"
+	"          MODE is sleep, spin, yield, jitter, or none; US is the "
+		"duration\n"
+	"          in microseconds (default 20); P is the probability in percent\n"
+	"          (default 100); FILE:LINE applies it to one call site only\n"
 	"    -i    Use interactive mode (display updates in alternate screen)\n"
+	"    --isolate[=S]  Run tests in -j worker processes; a crash fails the\n"
+	"          test, and a chunk of iterations taking over S seconds (default\n"
+	"          " S(DEFAULT_DEADLINE_S) ") times it out\n"
+	"    --watchdog[=MS]  If threads stay blocked with no semaphore activity\n"
+	"          for MS milliseconds (default " S(DEFAULT_WATCHDOG_MS) "), print "
+		"them and the\n"
+	"          problem's last events, and time out the test\n"
+	"    --estimate[=S]  Instead of testing, estimate how often each negative\n"
+	"          test fails, for up to S seconds per problem (default "
+		S(DEFAULT_ESTIMATE_S) ")\n"
+	"    --estimates=FILE  Save the estimates to FILE with --estimate;\n"
+	"          otherwise, load them and cut -n to what each problem needs\n"
+	"          (the backend, --place, and --set must match)\n"
+	"    --duration=S  Soak: instead of testing, run the positive tests\n"
+	"          continuously on -j jobs for S seconds, reporting throughput\n"
+	"          over time and the first failure of each problem\n"
+	"    --place=P  Pin jobs and problem threads to CPUs in turn, where P is\n"
+	"          one-cpu (all on one CPU), smt (the SMT siblings of one core),\n"
+	"          spread (one CPU per core), or a CPU list like 0-3,8\n"
+	"    --set=K=V,...  Change sizes of the problem given by -t (or of every\n"
+	"          problem with those parameters), like producers=512,buffer=64\n"
+	"    --params  List the parameters of each problem and exit\n"
+	"\n"
+	"  Output options\n"
+	"    --format=F     Write results as F: table (default), json, or csv\n"
+	"    --output=FILE  Write json or csv results to FILE, not stdout\n"
+	"    --allocs       Report heap and arena allocations per iteration and\n"
+	"          the time the arena saved, after the table\n"
 	"\n";
 
 #undef S
 #undef S_
 
-int main(int argc, char **argv) {
-	setup_util(argv[0]);
-	if (argc == 2 && strcmp(argv[1], "--help") == 0) {
-		fputs(usage_message, stdout);
+// Values returned by 'getopt_long' for options with no short form.
+enum {
+	OPT_FORMAT = 256,
+	OPT_OUTPUT,
+	OPT_ISOLATE,
+	OPT_WATCHDOG,
+	OPT_ESTIMATE,
+	OPT_ESTIMATES,
+	OPT_DURATION,
+	OPT_PLACE,
+	OPT_SET,
+	OPT_PARAMS,
+	OPT_ALLOCS
+};
+
+// Long options, for options that have no single-letter form.
+static const struct option long_options[] = {
+	{ "format", required_argument, NULL, OPT_FORMAT },
+	{ "output", required_argument, NULL, OPT_OUTPUT },
+	{ "isolate", optional_argument, NULL, OPT_ISOLATE },
+	{ "watchdog", optional_argument, NULL, OPT_WATCHDOG },
+	{ "estimate", optional_argument, NULL, OPT_ESTIMATE },
+	{ "estimates", required_argument, NULL, OPT_ESTIMATES },
+	{ "duration", required_argument, NULL, OPT_DURATION },
+	{ "place", required_argument, NULL, OPT_PLACE },
+	{ "set", required_argument, NULL, OPT_SET },
+	{ "params", no_argument, NULL, OPT_PARAMS },
+	{ "allocs", no_argument, NULL, OPT_ALLOCS },
+	{ "help", no_argument, NULL, 'h' },
+	{ NULL, 0, NULL, 0 }
+};
+
+// Names of the result formats, indexed by 'enum Format'.
+static const char *const format_names[] = { "table", "json", "csv" };
+
+#define N_FORMATS (sizeof format_names / sizeof format_names[0])
+
+// Placement policies for --place, besides explicit CPU lists.
+static const enum Placement placements[] = {
+	PLACE_ONE_CPU,
+	PLACE_SMT_SIBLINGS,
+	PLACE_SPREAD
+};
+
+#define N_PLACEMENTS (sizeof placements / sizeof placements[0])
+
+// Chooses CPUs for the placement policy or CPU list 'str' from the machine's
+// topology. Stores them in 'cpus' (which must have room for MAX_CPUS) and
+// returns how many there are. Prints an error message and returns zero on
+// failure.
+static int parse_placement(const char *str, int *cpus) {
+	struct Topology topo;
+	if (!topo_load(&topo)) {
+		printf_error("CPU topology is not available on this platform");
 		return 0;
 	}
+	for (size_t i = 0; i < N_PLACEMENTS; i++) {
+		if (strcmp(str, placement_name(placements[i])) == 0) {
+			int n = topo_choose(&topo, placements[i], cpus, MAX_CPUS);
+			if (n == 0) {
+				printf_error("%s: placement not available on this machine",
+						str);
+			}
+			return n;
+		}
+	}
+	int n = parse_cpu_list(str, cpus, MAX_CPUS);
+	if (n <= 0) {
+		printf_error("%s: unknown placement (should be one-cpu, smt, spread, "
+				"or a CPU list)", str);
+		return 0;
+	}
+	for (int i = 0; i < n; i++) {
+		bool usable = false;
+		for (int j = 0; j < topo.n_cpus; j++) {
+			usable |= topo.cpu[j] == cpus[i];
+		}
+		if (!usable) {
+			printf_error("%s: CPU %d is not available", str, cpus[i]);
+			return 0;
+		}
+	}
+	return n;
+}
+
+// Prints the parameters of each problem that has them, with their defaults
+// and ranges.
+static void print_params(void) {
+	for (int n = 1; n <= N_PROBLEMS; n++) {
+		const struct ProblemParam *p = get_problem_params(n);
+		if (!p) {
+			continue;
+		}
+		printf("%2d. %s\n", n, get_problem_name(n));
+		for (; p->key; p++) {
+			printf("    %-10s %5d  (%d to %d", p->key, *p->value, p->min,
+					p->max);
+			if (p->step > 1) {
+				printf(" in steps of %d", p->step);
+			}
+			printf(")\n");
+		}
+	}
+}
+
+// Parses a result format name. Stores the result in 'out' and returns true on
+// success; prints an error message and returns false on failure.
+static bool parse_format(enum Format *out, const char *str) {
+	for (size_t i = 0; i < N_FORMATS; i++) {
+		if (strcmp(str, format_names[i]) == 0) {
+			*out = (enum Format)i;
+			return true;
+		}
+	}
+	printf_error("%s: unknown format (should be table, json, or csv)", str);
+	return false;
+}
+
+int main(int argc, char **argv) {
+	setup_util(argv[0]);
 
 	// Initialize the default parameters.
 	struct Parameters params = {
@@ -56,14 +219,36 @@ int main(int argc, char **argv) {
 		.pos_iters = DEFAULT_POS_ITERS,
 		.neg_iters = DEFAULT_NEG_ITERS,
 		.jobs = DEFAULT_JOBS,
-		.interactive = false
+		.interactive = false,
+		.format = FORMAT_TABLE,
+		.output = NULL,
+		.isolate = false,
+		.deadline_ms = DEFAULT_DEADLINE_S * 1000,
+		.watchdog_ms = 0,
+		.estimate_ms = 0,
+		.estimates = NULL,
+		.duration_s = 0,
+		.placement = NULL,
+		.cpus = NULL,
+		.n_cpus = 0,
+		.settings = NULL,
+		.allocs = false
 	};
+	int cpus[MAX_CPUS];
+
+	// Semaphore options are not part of the test parameters.
+	int spin_limit = 0;
+	int wait_limit_ms = 0;
+	bool collect_stats = false;
+	bool use_eventfd = false;
+	bool use_fifo = false;
 
 	// Get command line options.
 	int c;
 	extern char *optarg;
 	extern int optind, optopt;
-	while ((c = getopt(argc, argv, "t:p:n:j:ih")) != -1) {
+	while ((c = getopt_long(argc, argv, "t:p:n:j:s:w:cefd:ih",
+			long_options, NULL)) != -1) {
 		switch (c) {
 		case 't':
 			if (!parse_int(&params.problem, optarg)) {
@@ -76,7 +261,7 @@ int main(int argc, char **argv) {
 			}
 			break;
 		case 'p':
-			if (!parse_int(&params.pos_iters, optarg)) {
+			if (!parse_long_long(&params.pos_iters, optarg)) {
 				return 1;
 			}
 			if (params.pos_iters < 0) {
@@ -84,13 +269,13 @@ int main(int argc, char **argv) {
 				return 1;
 			}
 			if (params.pos_iters > MAX_ITERS) {
-				printf_error("%s: iterations too large (maximum %d)",
+				printf_error("%s: iterations too large (maximum %lld)",
 						optarg, MAX_ITERS);
 				return 1;
 			}
 			break;
 		case 'n':
-			if (!parse_int(&params.neg_iters, optarg)) {
+			if (!parse_long_long(&params.neg_iters, optarg)) {
 				return 1;
 			}
 			if (params.neg_iters < 0) {
@@ -98,7 +283,7 @@ int main(int argc, char **argv) {
 				return 1;
 			}
 			if (params.neg_iters > MAX_ITERS) {
-				printf_error("%s: iterations too large (maximum %d)",
+				printf_error("%s: iterations too large (maximum %lld)",
 						optarg, MAX_ITERS);
 				return 1;
 			}
@@ -117,9 +302,133 @@ int main(int argc, char **argv) {
 				return 1;
 			}
 			break;
+		case 's':
+			if (!parse_int(&spin_limit, optarg)) {
+				return 1;
+			}
+			if (spin_limit < 0) {
+				printf_error("%s: spin limit must be nonnegative", optarg);
+				return 1;
+			}
+			if (spin_limit > MAX_SPIN) {
+				printf_error("%s: spin limit too large (maximum %d)",
+						optarg, MAX_SPIN);
+				return 1;
+			}
+			break;
+		case 'w':
+			if (!parse_int(&wait_limit_ms, optarg)) {
+				return 1;
+			}
+			if (wait_limit_ms < 0) {
+				printf_error("%s: wait limit must be nonnegative", optarg);
+				return 1;
+			}
+			if (wait_limit_ms > MAX_WAIT_MS) {
+				printf_error("%s: wait limit too large (maximum %d)",
+						optarg, MAX_WAIT_MS);
+				return 1;
+			}
+			break;
+		case 'c':
+			collect_stats = true;
+			break;
+		case 'e':
+			use_eventfd = true;
+			break;
+		case 'f':
+			use_fifo = true;
+			break;
+		case 'd':
+			if (!delay_configure(optarg)) {
+				return 1;
+			}
+			break;
 		case 'i':
 			params.interactive = true;
 			break;
+		case OPT_FORMAT:
+			if (!parse_format(&params.format, optarg)) {
+				return 1;
+			}
+			break;
+		case OPT_OUTPUT:
+			params.output = optarg;
+			break;
+		case OPT_ISOLATE:
+			params.isolate = true;
+			if (optarg) {
+				int deadline_s;
+				if (!parse_int(&deadline_s, optarg)) {
+					return 1;
+				}
+				if (deadline_s <= 0 || deadline_s > MAX_DEADLINE_S) {
+					printf_error("%s: deadline must be between 1 and %d "
+							"seconds", optarg, MAX_DEADLINE_S);
+					return 1;
+				}
+				params.deadline_ms = deadline_s * 1000;
+			}
+			break;
+		case OPT_WATCHDOG:
+			params.watchdog_ms = DEFAULT_WATCHDOG_MS;
+			if (optarg) {
+				if (!parse_int(&params.watchdog_ms, optarg)) {
+					return 1;
+				}
+				if (params.watchdog_ms <= 0
+						|| params.watchdog_ms > MAX_WAIT_MS) {
+					printf_error("%s: watchdog interval must be between 1 and "
+							"%d milliseconds", optarg, MAX_WAIT_MS);
+					return 1;
+				}
+			}
+			break;
+		case OPT_ESTIMATE:
+			params.estimate_ms = DEFAULT_ESTIMATE_S * 1000;
+			if (optarg) {
+				int budget_s;
+				if (!parse_int(&budget_s, optarg)) {
+					return 1;
+				}
+				if (budget_s <= 0 || budget_s > MAX_DEADLINE_S) {
+					printf_error("%s: time budget must be between 1 and %d "
+							"seconds", optarg, MAX_DEADLINE_S);
+					return 1;
+				}
+				params.estimate_ms = budget_s * 1000;
+			}
+			break;
+		case OPT_ESTIMATES:
+			params.estimates = optarg;
+			break;
+		case OPT_DURATION:
+			if (!parse_int(&params.duration_s, optarg)) {
+				return 1;
+			}
+			if (params.duration_s <= 0 || params.duration_s > MAX_DURATION_S) {
+				printf_error("%s: duration must be between 1 and %d seconds",
+						optarg, MAX_DURATION_S);
+				return 1;
+			}
+			break;
+		case OPT_SET:
+			params.settings = optarg;
+			break;
+		case OPT_PARAMS:
+			print_params();
+			return 0;
+		case OPT_ALLOCS:
+			params.allocs = true;
+			break;
+		case OPT_PLACE:
+			params.n_cpus = parse_placement(optarg, cpus);
+			if (params.n_cpus == 0) {
+				return 1;
+			}
+			params.placement = optarg;
+			params.cpus = cpus;
+			break;
 		case 'h':
 			fputs(usage_message, stdout);
 			return 0;
@@ -133,11 +442,52 @@ int main(int argc, char **argv) {
 		printf_error("interactive mode cannot be used for single tests");
 		return 1;
 	}
+	if (params.output && params.format == FORMAT_TABLE) {
+		printf_error("--output requires --format=json or --format=csv");
+		return 1;
+	}
+	if (params.interactive && params.format != FORMAT_TABLE
+			&& !params.output) {
+		printf_error("interactive mode needs --output with --format");
+		return 1;
+	}
+	if (params.estimate_ms > 0 && (params.interactive || params.isolate
+				|| params.format != FORMAT_TABLE)) {
+		printf_error("--estimate cannot be used with -i, --isolate, or "
+				"--format");
+		return 1;
+	}
+	if (params.duration_s > 0 && (params.interactive || params.isolate
+				|| params.estimate_ms > 0 || params.format != FORMAT_TABLE)) {
+		printf_error("--duration cannot be used with -i, --isolate, "
+				"--estimate, or --format");
+		return 1;
+	}
+	if (use_eventfd && use_fifo) {
+		printf_error("-e and -f cannot be used together");
+		return 1;
+	}
 	// Make sure all arguments were processed.
 	if (optind != argc) {
 		fputs(usage_message, stderr);
 		return 1;
 	}
 
+	// Apply settings once the problem is known, since -t can come after.
+	if (params.settings && !set_problem_params(params.problem,
+				params.settings)) {
+		return 1;
+	}
+
+	if (use_eventfd && !sema_set_backend(SEMA_EVENTFD)) {
+		printf_error("eventfd semaphores are not supported on this platform");
+		return 1;
+	}
+	if (use_fifo) {
+		sema_set_backend(SEMA_FIFO);
+	}
+	sema_set_spin_limit(spin_limit);
+	sema_set_wait_limit(wait_limit_ms * 1000000LL);
+	sema_enable_stats(collect_stats);
 	return run_tests(&params) ? 0 : 1;
 }
@@ -0,0 +1,117 @@
+// Copyright 2016 Mitchell Kember. Subject to the MIT License.
+
+#include "metrics.h"
+
+#include "arena.h"
+#include "util.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+// An entry in the metrics registry, keyed by scope and name.
+struct MetricEntry {
+	int scope;
+	struct Metric metric;
+	struct MetricEntry *next;
+};
+
+// Scope recorded for durations from this thread.
+static _Thread_local int metric_scope = 0;
+
+// The metrics registry, as a list in insertion order.
+static struct MetricEntry *registry_head = NULL;
+static struct MetricEntry **registry_tail = &registry_head;
+static pthread_mutex_t registry_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+void metric_set_scope(int scope) {
+	metric_scope = scope;
+}
+
+void metric_record(const char *name, long long ns) {
+	pthread_mutex_lock(&registry_mutex);
+	struct MetricEntry *e = registry_head;
+	while (e && !(e->scope == metric_scope
+			&& strcmp(e->metric.name, name) == 0)) {
+		e = e->next;
+	}
+	if (e == NULL) {
+		e = calloc(1, sizeof *e);
+		arena_count_heap();
+		e->scope = metric_scope;
+		e->metric.name = name;
+		*registry_tail = e;
+		registry_tail = &e->next;
+	}
+	e->metric.count++;
+	e->metric.total_ns += ns;
+	e->metric.max_ns = MAX(e->metric.max_ns, ns);
+	pthread_mutex_unlock(&registry_mutex);
+}
+
+size_t metric_get(int scope, struct Metric *out, size_t max) {
+	size_t n = 0;
+	pthread_mutex_lock(&registry_mutex);
+	for (struct MetricEntry *e = registry_head; e && n < max; e = e->next) {
+		if (e->scope == scope) {
+			out[n++] = e->metric;
+		}
+	}
+	pthread_mutex_unlock(&registry_mutex);
+	return n;
+}
+
+// Returns the bucket for a duration.
+static size_t hist_bucket(long long ns) {
+	unsigned long long v = ns < 0 ? 0 : (unsigned long long)ns;
+	if (v < 8) {
+		return (size_t)v;
+	}
+	int msb = 63 - __builtin_clzll(v);
+	return (size_t)(msb - 2) * 8 + ((v >> (msb - 3)) & 7);
+}
+
+// Returns the smallest duration in a bucket.
+static long long hist_lower(size_t bucket) {
+	if (bucket < 8) {
+		return (long long)bucket;
+	}
+	int msb = (int)(bucket / 8) + 2;
+	return (long long)((8 + bucket % 8) << (msb - 3));
+}
+
+void hist_init(struct Histogram *h) {
+	memset(h, 0, sizeof *h);
+}
+
+void hist_record(struct Histogram *h, long long ns) {
+	h->count++;
+	h->max_ns = MAX(h->max_ns, ns);
+	h->buckets[MIN(hist_bucket(ns), HIST_BUCKETS - 1)]++;
+}
+
+void hist_merge(struct Histogram *dst, const struct Histogram *src) {
+	dst->count += src->count;
+	dst->max_ns = MAX(dst->max_ns, src->max_ns);
+	for (size_t i = 0; i < HIST_BUCKETS; i++) {
+		dst->buckets[i] += src->buckets[i];
+	}
+}
+
+long long hist_percentile(const struct Histogram *h, double q) {
+	if (h->count == 0) {
+		return 0;
+	}
+	unsigned long long rank = (unsigned long long)(q * (double)h->count);
+	rank = MAX(1, MIN(rank, h->count));
+	unsigned long long seen = 0;
+	for (size_t i = 0; i < HIST_BUCKETS; i++) {
+		seen += h->buckets[i];
+		if (seen >= rank) {
+			long long end = i + 1 < HIST_BUCKETS ? hist_lower(i + 1) - 1
+				: h->max_ns;
+			return MIN(end, h->max_ns);
+		}
+	}
+	return h->max_ns;
+}
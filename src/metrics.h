@@ -0,0 +1,54 @@
+// Copyright 2016 Mitchell Kember. Subject to the MIT License.
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+
+// Summary of the durations recorded under one name in one scope.
+struct Metric {
+	const char *name;      // name given to 'metric_record'
+	unsigned long count;   // number of durations recorded
+	long long total_ns;    // sum of the durations, in nanoseconds
+	long long max_ns;      // longest duration, in nanoseconds
+};
+
+// Number of buckets in a histogram. Values below 8 ns have their own buckets,
+// and every power of two above that is split into eight, so a bucket is never
+// wider than 12.5% of the values in it.
+#define HIST_BUCKETS 488
+
+// A histogram of durations, for percentiles over any number of samples.
+struct Histogram {
+	unsigned long long count;                  // number of durations recorded
+	long long max_ns;                          // longest duration
+	unsigned long long buckets[HIST_BUCKETS];  // counts by 'hist_bucket'
+};
+
+// Sets the scope (for example, a problem number) under which durations
+// recorded by the calling thread are stored.
+void metric_set_scope(int scope);
+
+// Records a duration in nanoseconds under 'name', which must outlive the
+// program (normally it is a string literal).
+void metric_record(const char *name, long long ns);
+
+// Copies up to 'max' metrics for 'scope' into 'out', in the order the names
+// were first recorded. Returns the number of metrics copied.
+size_t metric_get(int scope, struct Metric *out, size_t max);
+
+// Empties a histogram.
+void hist_init(struct Histogram *h);
+
+// Records a duration in nanoseconds.
+void hist_record(struct Histogram *h, long long ns);
+
+// Adds the durations recorded in 'src' to 'dst'.
+void hist_merge(struct Histogram *dst, const struct Histogram *src);
+
+// Returns the duration below which a fraction 'q' (from 0 to 1) of the
+// recorded durations fall, rounded up to the end of its bucket but no more
+// than the maximum. Returns 0 if the histogram is empty.
+long long hist_percentile(const struct Histogram *h, double q);
+
+#endif
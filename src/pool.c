@@ -0,0 +1,224 @@
+// Copyright 2016 Mitchell Kember. Subject to the MIT License.
+
+#include "pool.h"
+
+#include "arena.h"
+#include "semaphore.h"
+#include "topology.h"
+#include "util.h"
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+// A thread in the pool. It parks until it is given a role, runs it, and then
+// returns to the idle list.
+struct PoolThread {
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	struct GroupRole *role;        // assigned role, or NULL if idle
+	struct PoolThread *next;  // next thread in the idle list
+};
+
+// Whether 'group_join' uses the pool.
+static bool pool_enabled = true;
+
+// Stack of idle threads, and the number of threads created.
+static pthread_mutex_t idle_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct PoolThread *idle = NULL;
+static atomic_size_t n_threads = 0;
+
+// CPUs that role threads are pinned to, and the number of them.
+static const int *role_cpus = NULL;
+static int n_role_cpus = 0;
+
+// CPU the calling thread is pinned to, or -1 if it has not been pinned.
+static _Thread_local int pinned_cpu = -1;
+
+// CPU time used by roles of the groups joined by this thread.
+static _Thread_local long long joined_cpu_ns = 0;
+
+// Waits for the role's group to start, then runs the role.
+static void run_role(struct GroupRole *role) {
+	struct Group *g = role->group;
+	pthread_mutex_lock(&g->mutex);
+	while (!g->started) {
+		pthread_cond_wait(&g->cond, &g->mutex);
+	}
+	pthread_mutex_unlock(&g->mutex);
+	int index = (int)(role - g->roles);
+	sema_set_thread_role(role->name, index);
+	if (n_role_cpus > 0 && pinned_cpu != role_cpus[index % n_role_cpus]) {
+		pinned_cpu = role_cpus[index % n_role_cpus];
+		pin_thread(pthread_self(), &pinned_cpu, 1);
+	}
+	arena_share(g->arena);
+	long long start = thread_cpu_ns();
+	role->fn(role->arg);
+	role->cpu_ns = thread_cpu_ns() - start;
+	// Pool threads outlive the role, so fold its statistics before the group
+	// (and the semaphores it used) can be destroyed.
+	sema_flush_thread_stats();
+	arena_share(NULL);
+}
+
+// Records that a role in the group has finished. The group may be gone as soon
+// as this returns.
+static void finish_role(struct Group *g) {
+	pthread_mutex_lock(&g->mutex);
+	if (--g->running == 0) {
+		pthread_cond_broadcast(&g->cond);
+	}
+	pthread_mutex_unlock(&g->mutex);
+}
+
+static void *run_pool_thread(void *ptr) {
+	struct PoolThread *t = ptr;
+	for (;;) {
+		pthread_mutex_lock(&t->mutex);
+		while (t->role == NULL) {
+			pthread_cond_wait(&t->cond, &t->mutex);
+		}
+		struct GroupRole *role = t->role;
+		t->role = NULL;
+		pthread_mutex_unlock(&t->mutex);
+
+		run_role(role);
+		struct Group *g = role->group;
+		pthread_mutex_lock(&idle_mutex);
+		t->next = idle;
+		idle = t;
+		pthread_mutex_unlock(&idle_mutex);
+		finish_role(g);
+	}
+	return NULL;
+}
+
+static void *run_unpooled(void *ptr) {
+	struct GroupRole *role = ptr;
+	run_role(role);
+	finish_role(role->group);
+	return NULL;
+}
+
+// Gives the role to an idle thread, creating a new one if there are none.
+static void dispatch(struct GroupRole *role) {
+	pthread_mutex_lock(&idle_mutex);
+	struct PoolThread *t = idle;
+	if (t) {
+		idle = t->next;
+	}
+	pthread_mutex_unlock(&idle_mutex);
+
+	if (t == NULL) {
+		t = malloc(sizeof *t);
+		arena_count_heap();
+		pthread_mutex_init(&t->mutex, NULL);
+		pthread_cond_init(&t->cond, NULL);
+		t->role = role;
+		t->next = NULL;
+		pthread_t thread;
+		int err = pthread_create(&thread, NULL, run_pool_thread, t);
+		if (err != 0) {
+			printf_error("error creating pool thread: %s", strerror(err));
+			exit(1);
+		}
+		pthread_detach(thread);
+		atomic_fetch_add(&n_threads, 1);
+		return;
+	}
+	pthread_mutex_lock(&t->mutex);
+	t->role = role;
+	pthread_cond_signal(&t->cond);
+	pthread_mutex_unlock(&t->mutex);
+}
+
+void group_init(struct Group *g) {
+	pthread_mutex_init(&g->mutex, NULL);
+	pthread_cond_init(&g->cond, NULL);
+	g->started = false;
+	g->n = 0;
+	g->running = 0;
+	g->cap = GROUP_INITIAL_ROLES;
+	g->roles = arena_alloc(g->cap * sizeof *g->roles, &g->roles_in_arena);
+	g->arena = arena_current();
+}
+
+void group_spawn_named(struct Group *g, const char *name, void *(*fn)(void *),
+		void *arg) {
+	assert(!g->started);
+	if (g->n == g->cap) {
+		bool in_arena;
+		struct GroupRole *roles =
+			arena_alloc(2 * g->cap * sizeof *roles, &in_arena);
+		memcpy(roles, g->roles, g->n * sizeof *roles);
+		arena_free(g->roles, g->roles_in_arena);
+		g->roles = roles;
+		g->roles_in_arena = in_arena;
+		g->cap *= 2;
+	}
+	g->roles[g->n++] = (struct GroupRole){
+		.name = name, .fn = fn, .arg = arg, .group = g
+	};
+}
+
+void group_start(struct Group *g) {
+	assert(!g->started);
+	g->running = g->n;
+	for (size_t i = 0; i < g->n; i++) {
+		struct GroupRole *role = &g->roles[i];
+		if (pool_enabled) {
+			dispatch(role);
+		} else {
+			int err = pthread_create(&role->thread, NULL, run_unpooled, role);
+			if (err != 0) {
+				printf_error("error creating thread: %s", strerror(err));
+				exit(1);
+			}
+		}
+	}
+
+	pthread_mutex_lock(&g->mutex);
+	g->started = true;
+	pthread_cond_broadcast(&g->cond);
+	pthread_mutex_unlock(&g->mutex);
+}
+
+void group_join(struct Group *g) {
+	if (!g->started) {
+		group_start(g);
+	}
+	pthread_mutex_lock(&g->mutex);
+	while (g->running > 0) {
+		pthread_cond_wait(&g->cond, &g->mutex);
+	}
+	pthread_mutex_unlock(&g->mutex);
+
+	for (size_t i = 0; i < g->n; i++) {
+		if (!pool_enabled) {
+			pthread_join(g->roles[i].thread, NULL);
+		}
+		joined_cpu_ns += g->roles[i].cpu_ns;
+	}
+	arena_free(g->roles, g->roles_in_arena);
+	pthread_cond_destroy(&g->cond);
+	pthread_mutex_destroy(&g->mutex);
+}
+
+void pool_set_enabled(bool enabled) {
+	pool_enabled = enabled;
+}
+
+void pool_set_cpus(const int *cpus, int n) {
+	role_cpus = cpus;
+	n_role_cpus = n;
+}
+
+long long pool_cpu_ns(void) {
+	return joined_cpu_ns;
+}
+
+size_t pool_size(void) {
+	return atomic_load(&n_threads);
+}
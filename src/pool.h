@@ -0,0 +1,81 @@
+// Copyright 2016 Mitchell Kember. Subject to the MIT License.
+
+#ifndef POOL_H
+#define POOL_H
+
+#include "arena.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Number of roles a group has room for before it first grows.
+#define GROUP_INITIAL_ROLES 16
+
+// A function run by one thread of a group, and its argument.
+struct GroupRole {
+	const char *name;  // name of 'fn', for the deadlock watchdog
+	void *(*fn)(void *);
+	void *arg;
+	struct Group *group;
+	pthread_t thread;  // only used when the pool is disabled
+	long long cpu_ns;  // CPU time used by 'fn'
+};
+
+// A Group is a set of roles that run concurrently, each on its own thread. The
+// threads come from a process-wide pool of parked threads, so running a group
+// does not create any threads once the pool is big enough. All roles begin at
+// the same moment, after the last one is dispatched.
+struct Group {
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	bool started;   // whether the roles may begin
+	size_t n;       // number of roles
+	size_t running; // number of roles not yet finished
+	size_t cap;     // number of roles allocated
+	struct GroupRole *roles;
+	bool roles_in_arena;  // 'roles' is from an arena
+	struct Arena *arena;  // arena the roles allocate from, or null
+};
+
+// Initializes an empty group. Its roles share the calling thread's arena, if it
+// has one.
+void group_init(struct Group *g);
+
+// Adds a role to the group that calls 'fn(arg)'. It does not begin until the
+// group is started. The role is named after the function. A group can have any
+// number of roles, but they can only be added before it starts.
+#define group_spawn(g, fn, arg) group_spawn_named(g, #fn, fn, arg)
+
+// Like 'group_spawn', but gives the role an explicit name, which must outlive
+// the group (normally it is a string literal).
+void group_spawn_named(struct Group *g, const char *name, void *(*fn)(void *),
+		void *arg);
+
+// Dispatches all roles in the group to threads and starts them together,
+// without waiting for them to finish.
+void group_start(struct Group *g);
+
+// Starts the group if 'group_start' has not been called, and waits for all its
+// roles to finish. The group cannot be used again afterwards.
+void group_join(struct Group *g);
+
+// Enables or disables the pool. When it is disabled, 'group_join' creates a new
+// thread for each role and joins it. Must not be called while groups are
+// running. The pool is enabled by default.
+void pool_set_enabled(bool enabled);
+
+// Pins role threads to CPUs: role 'i' of every group runs on CPU 'cpus[i % n]'
+// (if pinning is supported). With 'n' equal to zero, roles run wherever the OS
+// puts them, which is the default. The array must outlive all groups. Must not
+// be called while groups are running.
+void pool_set_cpus(const int *cpus, int n);
+
+// Returns the total CPU time used by the roles of all groups the calling thread
+// has joined, in nanoseconds.
+long long pool_cpu_ns(void);
+
+// Returns the number of threads the pool has created so far.
+size_t pool_size(void);
+
+#endif
@@ -1,10 +1,11 @@
 // Copyright 2016 Mitchell Kember. Subject to the MIT License.
 
 #include "buffer.h"
+#include "delay.h"
+#include "pool.h"
 #include "problems.h"
 #include "semaphore.h"
 
-#include <pthread.h>
 #include <stddef.h>
 
 const char *const problem_01_name = "Signaling";
@@ -31,15 +32,15 @@ static void *run_b(void *ptr) {
 
 bool problem_01(bool positive) {
 	// Initialize the shared data.
-	struct Data data = { .sem = sema_create(0, positive) };
-	buf_init(&data.log, 2);
+	struct Data data = { .sem = sema_create_named("sem", 0, positive) };
+	buf_init_events(&data.log, 2);
 
 	// Create and run threads.
-	pthread_t thread_a, thread_b;
-	pthread_create(&thread_a, NULL, run_a, &data);
-	pthread_create(&thread_b, NULL, run_b, &data);
-	pthread_join(thread_a, NULL);
-	pthread_join(thread_b, NULL);
+	struct Group group;
+	group_init(&group);
+	group_spawn(&group, run_a, &data);
+	group_spawn(&group, run_b, &data);
+	group_join(&group);
 
 	// Check for success.
 	bool success = buf_eq(&data.log, "AB");
@@ -1,10 +1,11 @@
 // Copyright 2016 Mitchell Kember. Subject to the MIT License.
 
 #include "buffer.h"
+#include "delay.h"
+#include "pool.h"
 #include "problems.h"
 #include "semaphore.h"
 
-#include <pthread.h>
 #include <stddef.h>
 
 const char *const problem_02_name = "Rendezvous";
@@ -37,17 +38,17 @@ static void *run_b(void *ptr) {
 bool problem_02(bool positive) {
 	// Initialize the shared data.
 	struct Data data = {
-		.a_arrived = sema_create(0, positive),
-		.b_arrived = sema_create(0, positive)
+		.a_arrived = sema_create_named("a_arrived", 0, positive),
+		.b_arrived = sema_create_named("b_arrived", 0, positive)
 	};
-	buf_init(&data.log, 4);
+	buf_init_events(&data.log, 4);
 
 	// Create and run threads.
-	pthread_t thread_a, thread_b;
-	pthread_create(&thread_a, NULL, run_a, &data);
-	pthread_create(&thread_b, NULL, run_b, &data);
-	pthread_join(thread_a, NULL);
-	pthread_join(thread_b, NULL);
+	struct Group group;
+	group_init(&group);
+	group_spawn(&group, run_a, &data);
+	group_spawn(&group, run_b, &data);
+	group_join(&group);
 
 	// Check for success.
 	bool success =
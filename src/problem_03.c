@@ -1,15 +1,22 @@
 // Copyright 2016 Mitchell Kember. Subject to the MIT License.
 
+#include "delay.h"
+#include "pool.h"
 #include "problems.h"
 #include "semaphore.h"
 
-#include <pthread.h>
 #include <stddef.h>
 
-#define N_THREADS 10
+// Default sizes of the problem, which can be changed at runtime.
+static int n_threads = 10;
 
 const char *const problem_03_name = "Mutex";
 
+const struct ProblemParam problem_03_params[] = {
+	{ "threads", &n_threads, 1, PROBLEM_PARAM_MAX, 1, NULL, NULL },
+	{ NULL, NULL, 0, 0, 0, NULL, NULL }
+};
+
 struct Data {
 	Semaphore mutex;
 	int count;
@@ -26,21 +33,20 @@ static void *run(void *ptr) {
 bool problem_03(bool positive) {
 	// Initialize the shared data.
 	struct Data data = {
-		.mutex = sema_create(1, positive),
+		.mutex = sema_create_named("mutex", 1, positive),
 		.count = 0
 	};
 
 	// Create and run threads.
-	pthread_t threads[N_THREADS];
-	for (size_t i = 0; i < N_THREADS; i++) {
-		pthread_create(&threads[i], NULL, run, &data);
-	}
-	for (size_t i = 0; i < N_THREADS; i++) {
-		pthread_join(threads[i], NULL);
+	struct Group group;
+	group_init(&group);
+	for (int i = 0; i < n_threads; i++) {
+		group_spawn(&group, run, &data);
 	}
+	group_join(&group);
 
 	// Check for success.
-	bool success = data.count == N_THREADS;
+	bool success = data.count == n_threads;
 
 	// Clean up.
 	sema_destroy(data.mutex);
@@ -1,17 +1,25 @@
 // Copyright 2016 Mitchell Kember. Subject to the MIT License.
 
+#include "delay.h"
+#include "pool.h"
 #include "problems.h"
 #include "semaphore.h"
 
-#include <pthread.h>
 #include <stdatomic.h>
 #include <stddef.h>
 
-#define N_THREADS 10
-#define MAX_IN_CRITICAL 2
+// Default sizes of the problem, which can be changed at runtime.
+static int n_threads = 10;
+static int max_in_critical = 2;
 
 const char *const problem_04_name = "Multiplex";
 
+const struct ProblemParam problem_04_params[] = {
+	{ "threads", &n_threads, 1, PROBLEM_PARAM_MAX, 1, NULL, NULL },
+	{ "critical", &max_in_critical, 1, PROBLEM_PARAM_MAX, 1, NULL, NULL },
+	{ NULL, NULL, 0, 0, 0, NULL, NULL }
+};
+
 struct Data {
 	Semaphore multiplex;
 	atomic_int count;
@@ -30,21 +38,20 @@ static void *run(void *ptr) {
 bool problem_04(bool positive) {
 	// Initialize the shared data.
 	struct Data data = {
-		.multiplex = sema_create(MAX_IN_CRITICAL, positive),
+		.multiplex = sema_create_named("multiplex", max_in_critical, positive),
 		.count = 0
 	};
 
 	// Create and run threads.
-	pthread_t threads[N_THREADS];
-	for (size_t i = 0; i < N_THREADS; i++) {
-		pthread_create(&threads[i], NULL, run, &data);
-	}
-	for (size_t i = 0; i < N_THREADS; i++) {
-		pthread_join(threads[i], NULL);
+	struct Group group;
+	group_init(&group);
+	for (int i = 0; i < n_threads; i++) {
+		group_spawn(&group, run, &data);
 	}
+	group_join(&group);
 
 	// Check for success.
-	bool success = data.count >= 1 && data.count <= MAX_IN_CRITICAL;
+	bool success = data.count >= 1 && data.count <= max_in_critical;
 
 	// Clean up.
 	sema_destroy(data.multiplex);
@@ -1,16 +1,22 @@
 // Copyright 2016 Mitchell Kember. Subject to the MIT License.
 
 #include "buffer.h"
+#include "pool.h"
 #include "problems.h"
 #include "semaphore.h"
 
-#include <pthread.h>
 #include <stddef.h>
 
-#define N_THREADS 10
+// Default sizes of the problem, which can be changed at runtime.
+static int n_threads = 10;
 
 const char *const problem_05_name = "Barrier";
 
+const struct ProblemParam problem_05_params[] = {
+	{ "threads", &n_threads, 1, PROBLEM_PARAM_MAX, 1, NULL, NULL },
+	{ NULL, NULL, 0, 0, 0, NULL, NULL }
+};
+
 struct Data {
 	Semaphore mutex;
 	Semaphore turnstile;
@@ -25,7 +31,7 @@ static void *run(void *ptr) {
 
 	sema_wait(d->mutex);
 	d->count++;
-	if (d->count == N_THREADS) {
+	if (d->count == n_threads) {
 		sema_signal(d->turnstile);
 	}
 	sema_signal(d->mutex);
@@ -40,27 +46,26 @@ static void *run(void *ptr) {
 bool problem_05(bool positive) {
 	// Initialize the shared data.
 	struct Data data = {
-		.mutex = sema_create(1, positive),
-		.turnstile = sema_create(0, positive),
+		.mutex = sema_create_named("mutex", 1, positive),
+		.turnstile = sema_create_named("turnstile", 0, positive),
 		.count = 0
 	};
-	buf_init(&data.log, N_THREADS * 2);
+	buf_init_events(&data.log, n_threads * 2);
 
 	// Create and run threads.
-	pthread_t threads[N_THREADS];
-	for (size_t i = 0; i < N_THREADS; i++) {
-		pthread_create(&threads[i], NULL, run, &data);
-	}
-	for (size_t i = 0; i < N_THREADS; i++) {
-		pthread_join(threads[i], NULL);
+	struct Group group;
+	group_init(&group);
+	for (int i = 0; i < n_threads; i++) {
+		group_spawn(&group, run, &data);
 	}
+	group_join(&group);
 
 	// Check for success.
 	bool success = true;
-	for (size_t i = 0; i < N_THREADS; i++) {
+	for (int i = 0; i < n_threads; i++) {
 		success &= buf_read(&data.log, i) == '0';
 	}
-	for (size_t i = N_THREADS; i < N_THREADS * 2; i++) {
+	for (int i = n_threads; i < n_threads * 2; i++) {
 		success &= buf_read(&data.log, i) == '1';
 	}
 
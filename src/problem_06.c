@@ -1,17 +1,25 @@
 // Copyright 2016 Mitchell Kember. Subject to the MIT License.
 
 #include "buffer.h"
+#include "pool.h"
 #include "problems.h"
 #include "semaphore.h"
 
-#include <pthread.h>
+#include <limits.h>
 #include <stddef.h>
 
-#define N_THREADS 10
-#define N_ITERATIONS 3
+// Default sizes of the problem, which can be changed at runtime.
+static int n_threads = 10;
+static int n_iterations = 3;
 
 const char *const problem_06_name = "Reusable barrier";
 
+const struct ProblemParam problem_06_params[] = {
+	{ "threads", &n_threads, 1, PROBLEM_PARAM_MAX, 1, NULL, NULL },
+	{ "iterations", &n_iterations, 1, UCHAR_MAX, 1, NULL, NULL },
+	{ NULL, NULL, 0, 0, 0, NULL, NULL }
+};
+
 struct Data {
 	Semaphore mutex;
 	Semaphore turnstile1;
@@ -23,12 +31,12 @@ struct Data {
 static void *run(void *ptr) {
 	struct Data *d = ptr;
 
-	for (int i = 0; i < N_ITERATIONS; i++) {
+	for (int i = 0; i < n_iterations; i++) {
 		buf_push(&d->log, (unsigned char)i);
 
 		sema_wait(d->mutex);
 		d->count++;
-		if (d->count == N_THREADS) {
+		if (d->count == n_threads) {
 			sema_wait(d->turnstile2);
 			sema_signal(d->turnstile1);
 		}
@@ -55,27 +63,26 @@ static void *run(void *ptr) {
 bool problem_06(bool positive) {
 	// Initialize the shared data.
 	struct Data data = {
-		.mutex = sema_create(1, positive),
-		.turnstile1 = sema_create(0, positive),
-		.turnstile2 = sema_create(1, positive),
+		.mutex = sema_create_named("mutex", 1, positive),
+		.turnstile1 = sema_create_named("turnstile1", 0, positive),
+		.turnstile2 = sema_create_named("turnstile2", 1, positive),
 		.count = 0
 	};
-	buf_init(&data.log, N_THREADS * N_ITERATIONS);
+	buf_init_events(&data.log, n_threads * n_iterations);
 
 	// Create and run threads.
-	pthread_t threads[N_THREADS];
-	for (size_t i = 0; i < N_THREADS; i++) {
-		pthread_create(&threads[i], NULL, run, &data);
-	}
-	for (size_t i = 0; i < N_THREADS; i++) {
-		pthread_join(threads[i], NULL);
+	struct Group group;
+	group_init(&group);
+	for (int i = 0; i < n_threads; i++) {
+		group_spawn(&group, run, &data);
 	}
+	group_join(&group);
 
 	// Check for success.
 	bool success = true;
-	for (size_t i = 0; i < N_ITERATIONS; i++) {
-		for (size_t j = 0; j < N_THREADS; j++) {
-			size_t index = i * N_THREADS + j;
+	for (int i = 0; i < n_iterations; i++) {
+		for (int j = 0; j < n_threads; j++) {
+			size_t index = i * n_threads + j;
 			success &= buf_read(&data.log, index) == i;
 		}
 	}
@@ -1,16 +1,24 @@
 // Copyright 2016 Mitchell Kember. Subject to the MIT License.
 
 #include "buffer.h"
+#include "pool.h"
 #include "problems.h"
 #include "semaphore.h"
 
-#include <pthread.h>
 #include <stddef.h>
 
-#define N_THREADS 10
+// Default sizes of the problem, which can be changed at runtime.
+static int n_pairs = 5;
+
+#define N_THREADS (2 * n_pairs)
 
 const char *const problem_07_name = "Exclusive queue";
 
+const struct ProblemParam problem_07_params[] = {
+	{ "pairs", &n_pairs, 1, PROBLEM_PARAM_MAX, 1, NULL, NULL },
+	{ NULL, NULL, 0, 0, 0, NULL, NULL }
+};
+
 struct Data {
 	Semaphore mutex;
 	Semaphore rendezvous;
@@ -61,30 +69,29 @@ static void *run_follower(void *ptr) {
 bool problem_07(bool positive) {
 	// Initialize the shared data.
 	struct Data data = {
-		.mutex = sema_create(1, positive),
-		.rendezvous = sema_create(0, positive),
-		.leader_queue = sema_create(0, positive),
-		.follower_queue = sema_create(0, positive),
+		.mutex = sema_create_named("mutex", 1, positive),
+		.rendezvous = sema_create_named("rendezvous", 0, positive),
+		.leader_queue = sema_create_named("leader_queue", 0, positive),
+		.follower_queue = sema_create_named("follower_queue", 0, positive),
 		.leaders = 0,
 		.followers = 0
 	};
-	buf_init(&data.log, N_THREADS);
+	buf_init_events(&data.log, N_THREADS);
 
 	// Create and run threads.
-	pthread_t threads[N_THREADS];
-	for (size_t i = 0; i < N_THREADS / 2; i++) {
-		pthread_create(&threads[i], NULL, run_leader, &data);
-	}
-	for (size_t i = N_THREADS / 2; i < N_THREADS; i++) {
-		pthread_create(&threads[i], NULL, run_follower, &data);
+	struct Group group;
+	group_init(&group);
+	for (int i = 0; i < N_THREADS / 2; i++) {
+		group_spawn(&group, run_leader, &data);
 	}
-	for (size_t i = 0; i < N_THREADS; i++) {
-		pthread_join(threads[i], NULL);
+	for (int i = N_THREADS / 2; i < N_THREADS; i++) {
+		group_spawn(&group, run_follower, &data);
 	}
+	group_join(&group);
 
 	// Check for success.
 	bool success = true;
-	for (size_t i = 0; i < N_THREADS; i += 2) {
+	for (int i = 0; i < N_THREADS; i += 2) {
 		unsigned char c1 = buf_read(&data.log, i);
 		unsigned char c2 = buf_read(&data.log, i + 1);
 		success &= (c1 == 'L' && c2 == 'F') || (c1 == 'F' && c2 == 'L');
@@ -1,23 +1,34 @@
 // Copyright 2016 Mitchell Kember. Subject to the MIT License.
 
+#include "arena.h"
 #include "buffer.h"
+#include "delay.h"
+#include "pool.h"
 #include "problems.h"
 #include "semaphore.h"
 
-#include <pthread.h>
 #include <stddef.h>
+#include <stdlib.h>
 
-#define N_PRODUCERS 6
-#define N_CONSUMERS 4
-#define N_THREADS (N_PRODUCERS + N_CONSUMERS)
+// Default sizes of the problem, which can be changed at runtime.
+static int n_producers = 6;
+static int n_consumers = 4;
+
+#define N_THREADS (n_producers + n_consumers)
 
 const char *const problem_08_name = "Producer-consumer";
 
+const struct ProblemParam problem_08_params[] = {
+	{ "producers", &n_producers, 1, PROBLEM_PARAM_MAX, 1, NULL, NULL },
+	{ "consumers", &n_consumers, 1, PROBLEM_PARAM_MAX, 1, &n_producers, NULL },
+	{ NULL, NULL, 0, 0, 0, NULL, NULL }
+};
+
 struct Data {
 	Semaphore mutex;
 	Semaphore items;
-	unsigned char next;
-	struct Buffer buf;
+	unsigned next;
+	struct Buffer buf;  // items, two bytes each (most significant first)
 	struct Buffer log;
 };
 
@@ -26,9 +37,9 @@ static void *run_producer(void *ptr) {
 
 	delay();
 	sema_wait(d->mutex);
-	unsigned char item = d->next++;
-	buf_push(&d->buf, item);
-	buf_push2(&d->log, 'P', item);
+	unsigned item = d->next++;
+	buf_push2(&d->buf, (unsigned char)(item >> 8), (unsigned char)item);
+	buf_push_id(&d->log, 'P', item);
 	sema_signal(d->mutex);
 	sema_signal(d->items);
 
@@ -40,8 +51,9 @@ static void *run_consumer(void *ptr) {
 
 	sema_wait(d->items);
 	sema_wait(d->mutex);
-	unsigned char item = buf_pop(&d->buf);
-	buf_push2(&d->log, 'C', item);
+	unsigned item = buf_pop(&d->buf);
+	item |= (unsigned)buf_pop(&d->buf) << 8;
+	buf_push_id(&d->log, 'C', item);
 	sema_signal(d->mutex);
 
 	return NULL;
@@ -50,33 +62,34 @@ static void *run_consumer(void *ptr) {
 bool problem_08(bool positive) {
 	// Initialize the shared data.
 	struct Data data = {
-		.mutex = sema_create(1, positive),
-		.items = sema_create(0, positive),
+		.mutex = sema_create_named("mutex", 1, positive),
+		.items = sema_create_named("items", 0, positive),
 		.next = 0
 	};
-	buf_init(&data.buf, N_PRODUCERS);
-	buf_init(&data.log, N_THREADS * 2);
+	buf_init(&data.buf, (size_t)n_producers * 2);
+	buf_init_events(&data.log, (size_t)N_THREADS * 3);
 
 	// Create and run threads.
-	pthread_t threads[N_THREADS];
-	for (size_t i = 0; i < N_PRODUCERS; i++) {
-		pthread_create(&threads[i], NULL, run_producer, &data);
-	}
-	for (size_t i = N_PRODUCERS; i < N_THREADS; i++) {
-		pthread_create(&threads[i], NULL, run_consumer, &data);
+	struct Group group;
+	group_init(&group);
+	for (int i = 0; i < n_producers; i++) {
+		group_spawn(&group, run_producer, &data);
 	}
-	for (size_t i = 0; i < N_THREADS; i++) {
-		pthread_join(threads[i], NULL);
+	for (int i = n_producers; i < N_THREADS; i++) {
+		group_spawn(&group, run_consumer, &data);
 	}
+	group_join(&group);
 
 	// Check for success.
 	bool success = true;
-	bool waiting[N_PRODUCERS] = { false };
+	bool waiting_in_arena;
+	bool *waiting = arena_calloc(
+			(size_t)n_producers, sizeof *waiting, &waiting_in_arena);
 	size_t items = 0;
-	for (size_t i = 0; i < N_THREADS * 2; i += 2) {
+	for (size_t i = 0; i < (size_t)N_THREADS * 3; i += 3) {
 		unsigned char c1 = buf_read(&data.log, i);
-		unsigned char c2 = buf_read(&data.log, i + 1);
-		if (c2 >= N_PRODUCERS) {
+		unsigned c2 = buf_read_id(&data.log, i + 1);
+		if (c2 >= (unsigned)n_producers) {
 			success = false;
 			break;
 		}
@@ -94,10 +107,11 @@ bool problem_08(bool positive) {
 			break;
 		}
 	}
-	success &= items == N_PRODUCERS - N_CONSUMERS;
-	success &= data.buf.len == items;
+	success &= items == (size_t)(n_producers - n_consumers);
+	success &= buf_len(&data.buf) == items * 2;
 
 	// Clean up.
+	arena_free(waiting, waiting_in_arena);
 	sema_destroy(data.mutex);
 	sema_destroy(data.items);
 	buf_free(&data.log);
@@ -1,18 +1,27 @@
 // Copyright 2016 Mitchell Kember. Subject to the MIT License.
 
 #include "buffer.h"
+#include "delay.h"
+#include "pool.h"
 #include "problems.h"
 #include "semaphore.h"
 
-#include <pthread.h>
 #include <stddef.h>
 
-#define N_READERS 6
-#define N_WRITERS 4
-#define N_THREADS (N_READERS + N_WRITERS)
+// Default sizes of the problem, which can be changed at runtime.
+static int n_readers = 6;
+static int n_writers = 4;
+
+#define N_THREADS (n_readers + n_writers)
 
 const char *const problem_11_name = "No-starve R-W";
 
+const struct ProblemParam problem_11_params[] = {
+	{ "readers", &n_readers, 1, PROBLEM_PARAM_MAX, 1, NULL, NULL },
+	{ "writers", &n_writers, 1, PROBLEM_PARAM_MAX, 1, NULL, NULL },
+	{ NULL, NULL, 0, 0, 0, NULL, NULL }
+};
+
 struct Data {
 	Semaphore mutex;
 	Semaphore room_empty;
@@ -35,7 +44,7 @@ static void *run_reader(void *ptr) {
 	increment(&d->readers);
 	sema_signal(d->mutex);
 
-	buf_push2(&d->log, 'R', (unsigned char)d->value);
+	buf_push_id(&d->log, 'R', (unsigned)d->value);
 
 	sema_wait(d->mutex);
 	decrement(&d->readers);
@@ -53,7 +62,7 @@ static void *run_writer(void *ptr) {
 	sema_wait(d->turnstile);
 	sema_wait(d->room_empty);
 	increment(&d->value);
-	buf_push2(&d->log, 'W', (unsigned char)d->value);
+	buf_push_id(&d->log, 'W', (unsigned)d->value);
 	sema_signal(d->room_empty);
 	sema_signal(d->turnstile);
 
@@ -63,32 +72,31 @@ static void *run_writer(void *ptr) {
 bool problem_11(bool positive) {
 	// Initialize the shared data.
 	struct Data data = {
-		.mutex = sema_create(1, positive),
-		.room_empty = sema_create(1, positive),
-		.turnstile = sema_create(1, positive),
+		.mutex = sema_create_named("mutex", 1, positive),
+		.room_empty = sema_create_named("room_empty", 1, positive),
+		.turnstile = sema_create_named("turnstile", 1, positive),
 		.readers = 0,
 		.value = 0
 	};
-	buf_init(&data.log, N_THREADS * 2);
+	buf_init_events(&data.log, (size_t)N_THREADS * 3);
 
 	// Create and run threads.
-	pthread_t threads[N_THREADS];
-	for (size_t i = 0; i < N_READERS; i++) {
-		pthread_create(&threads[i], NULL, run_reader, &data);
-	}
-	for (size_t i = N_READERS; i < N_THREADS; i++) {
-		pthread_create(&threads[i], NULL, run_writer, &data);
+	struct Group group;
+	group_init(&group);
+	for (int i = 0; i < n_readers; i++) {
+		group_spawn(&group, run_reader, &data);
 	}
-	for (size_t i = 0; i < N_THREADS; i++) {
-		pthread_join(threads[i], NULL);
+	for (int i = n_readers; i < N_THREADS; i++) {
+		group_spawn(&group, run_writer, &data);
 	}
+	group_join(&group);
 
 	// Check for success.
 	bool success = true;
-	unsigned char value = 0;
-	for (size_t i = 0; i < N_THREADS * 2; i += 2) {
+	unsigned value = 0;
+	for (size_t i = 0; i < (size_t)N_THREADS * 3; i += 3) {
 		unsigned char c1 = buf_read(&data.log, i);
-		unsigned char c2 = buf_read(&data.log, i + 1);
+		unsigned c2 = buf_read_id(&data.log, i + 1);
 
 		if (c1 == 'R') {
 			success &= c2 == value;
@@ -100,7 +108,7 @@ bool problem_11(bool positive) {
 			break;
 		}
 	}
-	success &= value == N_WRITERS;
+	success &= value == (unsigned)n_writers;
 
 	// Clean up.
 	sema_destroy(data.mutex);
@@ -1,16 +1,25 @@
 // Copyright 2016 Mitchell Kember. Subject to the MIT License.
 
+#include "delay.h"
+#include "pool.h"
 #include "problems.h"
 #include "semaphore.h"
 
-#include <pthread.h>
+#include <limits.h>
 #include <stddef.h>
 
-#define N_THREADS 10
-#define N_ITERATIONS 2
+// Default sizes of the problem, which can be changed at runtime.
+static int n_threads = 10;
+static int n_iterations = 2;
 
 const char *const problem_13_name = "No-starve mutex";
 
+const struct ProblemParam problem_13_params[] = {
+	{ "threads", &n_threads, 1, PROBLEM_PARAM_MAX, 1, NULL, NULL },
+	{ "iterations", &n_iterations, 1, UCHAR_MAX, 1, NULL, NULL },
+	{ NULL, NULL, 0, 0, 0, NULL, NULL }
+};
+
 struct Data {
 	Semaphore mutex;
 	Semaphore turnstile1;
@@ -23,7 +32,7 @@ struct Data {
 static void *run(void *ptr) {
 	struct Data *d = ptr;
 
-	for (int i = 0; i < N_ITERATIONS; i++) {
+	for (int i = 0; i < n_iterations; i++) {
 		sema_wait(d->mutex);
 		d->room1++;
 		sema_signal(d->mutex);
@@ -59,25 +68,24 @@ static void *run(void *ptr) {
 bool problem_13(bool positive) {
 	// Initialize the shared data.
 	struct Data data = {
-		.mutex = sema_create(1, positive),
-		.turnstile1 = sema_create(1, positive),
-		.turnstile2 = sema_create(0, positive),
+		.mutex = sema_create_named("mutex", 1, positive),
+		.turnstile1 = sema_create_named("turnstile1", 1, positive),
+		.turnstile2 = sema_create_named("turnstile2", 0, positive),
 		.room1 = 0,
 		.room2 = 0,
 		.count = 0
 	};
 
 	// Create and run threads.
-	pthread_t threads[N_THREADS];
-	for (size_t i = 0; i < N_THREADS; i++) {
-		pthread_create(&threads[i], NULL, run, &data);
-	}
-	for (size_t i = 0; i < N_THREADS; i++) {
-		pthread_join(threads[i], NULL);
+	struct Group group;
+	group_init(&group);
+	for (int i = 0; i < n_threads; i++) {
+		group_spawn(&group, run, &data);
 	}
+	group_join(&group);
 
 	// Check for success.
-	bool success = data.count == N_THREADS * N_ITERATIONS;
+	bool success = data.count == n_threads * n_iterations;
 
 	// Clean up.
 	sema_destroy(data.mutex);
@@ -1,47 +1,82 @@
 // Copyright 2016 Mitchell Kember. Subject to the MIT License.
 
+#include "arena.h"
 #include "buffer.h"
+#include "delay.h"
+#include "pool.h"
 #include "problems.h"
 #include "semaphore.h"
 
-#include <pthread.h>
+#include <stdalign.h>
 #include <stddef.h>
+#include <stdlib.h>
 #include <string.h>
 
-#define N_THREADS 10
-#define N_FORKS 5
+// Default sizes of the problem, which can be changed at runtime. The number of
+// forks must be odd: with an even number, the philosophers at every other seat
+// can each hold one fork and wait for the next, which the multiplex allows.
+static int n_threads = 10;
+static int n_forks = 5;
 
-#define LEFT(i) (((i) + 1) % N_FORKS)
-#define RIGHT(i) (((i) - 1 + N_FORKS) % N_FORKS)
+// Whether the forks and seats use the padded layout (1) or the packed one (0).
+static int padded = 1;
+
+#define LEFT(i) (((i) + 1) % n_forks)
+#define RIGHT(i) (((i) - 1 + n_forks) % n_forks)
 
 const char *const problem_14_name = "Dining philosophers";
 
+const struct ProblemParam problem_14_params[] = {
+	{ "threads", &n_threads, 1, PROBLEM_PARAM_MAX, 1, NULL, NULL },
+	{ "forks", &n_forks, 3, PROBLEM_PARAM_MAX, 2, NULL, NULL },
+	{ "padded", &padded, 0, 1, 1, NULL, NULL },
+	{ NULL, NULL, 0, 0, 0, NULL, NULL }
+};
+
+// In the padded layout, the forks are padded to a cache line each, and the
+// seats (guarded by the mutex) are allocated separately and the log gets a line
+// of its own, since they are written by different threads at the same time. In
+// the packed layout, the forks are a plain array of semaphores followed by the
+// seats in the same allocation, for comparison.
 struct Data {
 	Semaphore mutex;
 	Semaphore multiplex;
-	Semaphore forks[N_FORKS];
-	int seats[N_FORKS];
-	struct Buffer log;
+	struct SemaArray forks;          // padded layout
+	struct Semaphore *packed_forks;  // packed layout, or null for dummies
+	void *packed;                    // allocation holding the packed layout
+	bool packed_in_arena;
+	int *seats;
+	bool seats_in_arena;
+	alignas(CACHE_LINE_SIZE) struct Buffer log;
 };
 
+static Semaphore fork_at(struct Data *d, int i) {
+	if (padded) {
+		return sema_at(&d->forks, (size_t)i);
+	}
+	return d->packed_forks ? &d->packed_forks[i] : NULL;
+}
+
 static void *run(void *ptr) {
 	struct Data *d = ptr;
-	int seats[N_FORKS];
+	bool seats_in_arena;
+	int *seats =
+		arena_alloc((size_t)n_forks * sizeof *seats, &seats_in_arena);
 
-	for (size_t i = 0; i < N_FORKS; i++) {
+	for (int i = 0; i < n_forks; i++) {
 		sema_wait(d->multiplex);
-		sema_wait(d->forks[LEFT(i)]);
-		sema_wait(d->forks[RIGHT(i)]);
+		sema_wait(fork_at(d, LEFT(i)));
+		sema_wait(fork_at(d, RIGHT(i)));
 
 		sema_wait(d->mutex);
 		d->seats[i]++;
-		memcpy(seats, d->seats, N_FORKS * sizeof *seats);
+		memcpy(seats, d->seats, (size_t)n_forks * sizeof *seats);
 		sema_signal(d->mutex);
 
 		delay();
 		int count = 0;
 		unsigned char result = 'Y';
-		for (size_t j = 0; j < N_FORKS; j++) {
+		for (int j = 0; j < n_forks; j++) {
 			int n = seats[j];
 			count += n;
 			if (n > 1) {
@@ -49,7 +84,7 @@ static void *run(void *ptr) {
 				break;
 			}
 		}
-		if (count > N_FORKS / 2) {
+		if (count > n_forks / 2) {
 			result = 'N';
 		}
 		buf_push(&d->log, result);
@@ -58,51 +93,70 @@ static void *run(void *ptr) {
 		d->seats[i]--;
 		sema_signal(d->mutex);
 
-		sema_signal(d->forks[LEFT(i)]);
-		sema_signal(d->forks[RIGHT(i)]);
+		sema_signal(fork_at(d, LEFT(i)));
+		sema_signal(fork_at(d, RIGHT(i)));
 		sema_signal(d->multiplex);
 	}
 
+	arena_free(seats, seats_in_arena);
 	return NULL;
 }
 
 bool problem_14(bool positive) {
 	// Initialize the shared data.
 	struct Data data = {
-		.mutex = sema_create(1, positive),
-		.multiplex = sema_create(N_FORKS - 1, positive),
-		.seats = { 0 }
+		.mutex = sema_create_named("mutex", 1, positive),
+		.multiplex = sema_create_named("multiplex", n_forks - 1, positive)
 	};
-	for (size_t i = 0; i < N_FORKS; i++) {
-		data.forks[i] = sema_create(1, positive);
+	const size_t n = (size_t)n_forks;
+	if (padded) {
+		sema_array_init(&data.forks, "forks", n, 1, positive);
+		data.seats = arena_calloc(n, sizeof *data.seats, &data.seats_in_arena);
+	} else {
+		data.packed = arena_alloc(n * sizeof *data.packed_forks
+				+ n * sizeof *data.seats, &data.packed_in_arena);
+		struct Semaphore *forks = data.packed;
+		data.seats = (int *)(forks + n);
+		memset(data.seats, 0, n * sizeof *data.seats);
+		if (positive) {
+			for (size_t i = 0; i < n; i++) {
+				sema_init(&forks[i], "forks", 1);
+			}
+			data.packed_forks = forks;
+		}
 	}
-	buf_init(&data.log, N_THREADS * N_FORKS);
+	buf_init_events(&data.log, (size_t)n_threads * (size_t)n_forks);
 
 	// Create and run threads.
-	pthread_t threads[N_THREADS];
-	for (size_t i = 0; i < N_THREADS; i++) {
-		pthread_create(&threads[i], NULL, run, &data);
-	}
-	for (size_t i = 0; i < N_THREADS; i++) {
-		pthread_join(threads[i], NULL);
+	struct Group group;
+	group_init(&group);
+	for (int i = 0; i < n_threads; i++) {
+		group_spawn(&group, run, &data);
 	}
+	group_join(&group);
 
 	// Check for success.
 	bool success = true;
-	for (size_t i = 0; i < N_THREADS * N_FORKS; i++) {
+	for (size_t i = 0; i < (size_t)n_threads * (size_t)n_forks; i++) {
 		success &= buf_read(&data.log, i) == 'Y';
 	}
-	for (size_t i = 0; i < N_FORKS; i++) {
+	for (int i = 0; i < n_forks; i++) {
 		success &= data.seats[i] == 0;
 	}
 
 	// Clean up.
 	sema_destroy(data.mutex);
 	sema_destroy(data.multiplex);
-	for (int i = 0; i < N_FORKS; i++) {
-		sema_destroy(data.forks[i]);
-	}
 	buf_free(&data.log);
+	if (padded) {
+		sema_array_destroy(&data.forks);
+		arena_free(data.seats, data.seats_in_arena);
+	} else {
+		for (size_t i = 0; data.packed_forks && i < n; i++) {
+			sema_fini(&data.packed_forks[i]);
+		}
+		arena_free(data.packed, data.packed_in_arena);
+	}
 
 	return success;
 }
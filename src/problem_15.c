@@ -1,10 +1,12 @@
 // Copyright 2016 Mitchell Kember. Subject to the MIT License.
 
 #include "buffer.h"
+#include "delay.h"
+#include "pool.h"
 #include "problems.h"
 #include "semaphore.h"
 
-#include <pthread.h>
+#include <stdalign.h>
 #include <stddef.h>
 
 enum Role {
@@ -25,30 +27,37 @@ enum Ingredient {
 
 const char *const problem_15_name = "Cigarette smokers";
 
+// Counter for numbering the threads of one role. Each role's counter is guarded
+// by a different mutex, so each gets a cache line of its own.
+struct Counter {
+	alignas(CACHE_LINE_SIZE) size_t value;
+};
+
+// The state guarded by 'pusher_mutex' and the log also get lines of their own.
 struct Data {
 	Semaphore agent;
 	Semaphore pusher_mutex;
-	Semaphore ingredients[N_INGREDIENTS];
-	Semaphore push_ingredients[N_INGREDIENTS];
-	Semaphore next_mutex[N_ROLES];
-	bool ingredient_ready[N_INGREDIENTS];
-	size_t next[N_ROLES];
-	struct Buffer log;
+	struct SemaArray ingredients;
+	struct SemaArray push_ingredients;
+	struct SemaArray next_mutex;
+	alignas(CACHE_LINE_SIZE) bool ingredient_ready[N_INGREDIENTS];
+	struct Counter next[N_ROLES];
+	alignas(CACHE_LINE_SIZE) struct Buffer log;
 };
 
 static void *run_agent(void *ptr) {
 	struct Data *d = ptr;
 
-	sema_wait(d->next_mutex[AGENT]);
-	size_t n = d->next[AGENT]++;
-	sema_signal(d->next_mutex[AGENT]);
+	sema_wait(sema_at(&d->next_mutex, AGENT));
+	size_t n = d->next[AGENT].value++;
+	sema_signal(sema_at(&d->next_mutex, AGENT));
 
 	sema_wait(d->agent);
 	delay();
 	buf_push2(&d->log, 'A', (unsigned char)n);
 	for (size_t i = 0; i < N_INGREDIENTS; i++) {
 		if (i != n) {
-			sema_signal(d->ingredients[i]);
+			sema_signal(sema_at(&d->ingredients, i));
 		}
 	}
 
@@ -58,18 +67,18 @@ static void *run_agent(void *ptr) {
 static void *run_pusher(void *ptr) {
 	struct Data *d = ptr;
 
-	sema_wait(d->next_mutex[PUSHER]);
-	size_t n = d->next[PUSHER]++;
-	sema_signal(d->next_mutex[PUSHER]);
+	sema_wait(sema_at(&d->next_mutex, PUSHER));
+	size_t n = d->next[PUSHER].value++;
+	sema_signal(sema_at(&d->next_mutex, PUSHER));
 
 	for (int count = 0; count < 2; count++) {
-		sema_wait(d->ingredients[n]);
+		sema_wait(sema_at(&d->ingredients, n));
 		sema_wait(d->pusher_mutex);
 		bool pushed = false;
 		for (size_t i = 0; i < N_INGREDIENTS; i++) {
 			if (i != n && d->ingredient_ready[i]) {
 				d->ingredient_ready[i] = false;
-				sema_signal(d->push_ingredients[N_INGREDIENTS-n-i]);
+				sema_signal(sema_at(&d->push_ingredients, N_INGREDIENTS-n-i));
 				pushed = true;
 				break;
 			}
@@ -86,11 +95,11 @@ static void *run_pusher(void *ptr) {
 static void *run_smoker(void *ptr) {
 	struct Data *d = ptr;
 
-	sema_wait(d->next_mutex[SMOKER]);
-	size_t n = d->next[SMOKER]++;
-	sema_signal(d->next_mutex[SMOKER]);
+	sema_wait(sema_at(&d->next_mutex, SMOKER));
+	size_t n = d->next[SMOKER].value++;
+	sema_signal(sema_at(&d->next_mutex, SMOKER));
 
-	sema_wait(d->push_ingredients[n]);
+	sema_wait(sema_at(&d->push_ingredients, n));
 	sema_signal(d->agent);
 	buf_push2(&d->log, 'S', (unsigned char)n);
 
@@ -100,30 +109,27 @@ static void *run_smoker(void *ptr) {
 bool problem_15(bool positive) {
 	// Initialize the shared data.
 	struct Data data = {
-		.agent = sema_create(1, positive),
-		.pusher_mutex = sema_create(1, positive),
+		.agent = sema_create_named("agent", 1, positive),
+		.pusher_mutex = sema_create_named("pusher_mutex", 1, positive),
 		.ingredient_ready = { false },
-		.next = { 0 }
+		.next = { { 0 } }
 	};
-	for (size_t i = 0; i < N_INGREDIENTS; i++) {
-		data.ingredients[i] = sema_create(0, positive);
-		data.push_ingredients[i] = sema_create(0, positive);
-	}
-	for (size_t i = 0; i < N_ROLES; i++) {
-		data.next_mutex[i] = sema_create(1, positive);
-	}
-	buf_init(&data.log, N_INGREDIENTS * 4);
+	sema_array_init(&data.ingredients, "ingredients", N_INGREDIENTS, 0,
+			positive);
+	sema_array_init(&data.push_ingredients, "push_ingredients", N_INGREDIENTS,
+			0, positive);
+	sema_array_init(&data.next_mutex, "next_mutex", N_ROLES, 1, positive);
+	buf_init_events(&data.log, N_INGREDIENTS * 4);
 
 	// Create and run threads.
-	pthread_t threads[N_THREADS];
+	struct Group group;
+	group_init(&group);
 	for (size_t i = 0; i < N_THREADS; i += N_ROLES) {
-		pthread_create(&threads[i], NULL, run_agent, &data);
-		pthread_create(&threads[i + 1], NULL, run_pusher, &data);
-		pthread_create(&threads[i + 2], NULL, run_smoker, &data);
-	}
-	for (size_t i = 0; i < N_THREADS; i++) {
-		pthread_join(threads[i], NULL);
+		group_spawn(&group, run_agent, &data);
+		group_spawn(&group, run_pusher, &data);
+		group_spawn(&group, run_smoker, &data);
 	}
+	group_join(&group);
 
 	// Check for success.
 	bool success = true;
@@ -154,13 +160,9 @@ bool problem_15(bool positive) {
 	// Clean up.
 	sema_destroy(data.agent);
 	sema_destroy(data.pusher_mutex);
-	for (size_t i = 0; i < N_INGREDIENTS; i++) {
-		sema_destroy(data.ingredients[i]);
-		sema_destroy(data.push_ingredients[i]);
-	}
-	for (size_t i = 0; i < N_ROLES; i++) {
-		sema_destroy(data.next_mutex[i]);
-	}
+	sema_array_destroy(&data.ingredients);
+	sema_array_destroy(&data.push_ingredients);
+	sema_array_destroy(&data.next_mutex);
 	buf_free(&data.log);
 
 	return success;
@@ -1,10 +1,12 @@
 // Copyright 2016 Mitchell Kember. Subject to the MIT License.
 
 #include "buffer.h"
+#include "delay.h"
+#include "pool.h"
 #include "problems.h"
 #include "semaphore.h"
 
-#include <pthread.h>
+#include <stdalign.h>
 #include <stddef.h>
 
 enum Role {
@@ -25,30 +27,37 @@ enum Ingredient {
 
 const char *const problem_16_name = "Generalized CS";
 
+// Counter for numbering the threads of one role. Each role's counter is guarded
+// by a different mutex, so each gets a cache line of its own.
+struct Counter {
+	alignas(CACHE_LINE_SIZE) size_t value;
+};
+
+// The state guarded by 'pusher_mutex' and the log also get lines of their own.
 struct Data {
 	Semaphore pusher_mutex;
-	Semaphore ingredients[N_INGREDIENTS];
-	Semaphore push_ingredients[N_INGREDIENTS];
-	Semaphore next_mutex[N_ROLES];
-	int ingredient_counts[N_INGREDIENTS];
+	struct SemaArray ingredients;
+	struct SemaArray push_ingredients;
+	struct SemaArray next_mutex;
+	alignas(CACHE_LINE_SIZE) int ingredient_counts[N_INGREDIENTS];
 	bool already_pushed[N_INGREDIENTS];
-	size_t next[N_ROLES];
-	struct Buffer log;
+	struct Counter next[N_ROLES];
+	alignas(CACHE_LINE_SIZE) struct Buffer log;
 };
 
 static void *run_agent(void *ptr) {
 	struct Data *d = ptr;
 
-	sema_wait(d->next_mutex[AGENT]);
-	size_t n = d->next[AGENT]++;
-	sema_signal(d->next_mutex[AGENT]);
+	sema_wait(sema_at(&d->next_mutex, AGENT));
+	size_t n = d->next[AGENT].value++;
+	sema_signal(sema_at(&d->next_mutex, AGENT));
 
 	delay();
 	buf_push2(&d->log, 'A', (unsigned char)n);
 	for (size_t i = 0; i < N_INGREDIENTS; i++) {
 		if (i != n) {
 			delay();
-			sema_signal(d->ingredients[i]);
+			sema_signal(sema_at(&d->ingredients, i));
 		}
 	}
 
@@ -58,12 +67,12 @@ static void *run_agent(void *ptr) {
 static void *run_pusher(void *ptr) {
 	struct Data *d = ptr;
 
-	sema_wait(d->next_mutex[PUSHER]);
-	size_t n = d->next[PUSHER]++;
-	sema_signal(d->next_mutex[PUSHER]);
+	sema_wait(sema_at(&d->next_mutex, PUSHER));
+	size_t n = d->next[PUSHER].value++;
+	sema_signal(sema_at(&d->next_mutex, PUSHER));
 
 	for (int count = 0; count < 2; count++) {
-		sema_wait(d->ingredients[n]);
+		sema_wait(sema_at(&d->ingredients, n));
 		sema_wait(d->pusher_mutex);
 		bool pushed = false;
 		for (size_t i = 0; i < N_INGREDIENTS; i++) {
@@ -72,7 +81,7 @@ static void *run_pusher(void *ptr) {
 					&& !d->already_pushed[other]) {
 				d->ingredient_counts[i]--;
 				d->already_pushed[other] = true;
-				sema_signal(d->push_ingredients[other]);
+				sema_signal(sema_at(&d->push_ingredients, other));
 				pushed = true;
 				break;
 			}
@@ -90,11 +99,11 @@ static void *run_smoker(void *ptr) {
 	struct Data *d = ptr;
 
 	delay();
-	sema_wait(d->next_mutex[SMOKER]);
-	size_t n = d->next[SMOKER]++;
-	sema_signal(d->next_mutex[SMOKER]);
+	sema_wait(sema_at(&d->next_mutex, SMOKER));
+	size_t n = d->next[SMOKER].value++;
+	sema_signal(sema_at(&d->next_mutex, SMOKER));
 
-	sema_wait(d->push_ingredients[n]);
+	sema_wait(sema_at(&d->push_ingredients, n));
 	buf_push2(&d->log, 'S', (unsigned char)n);
 
 	return NULL;
@@ -103,30 +112,27 @@ static void *run_smoker(void *ptr) {
 bool problem_16(bool positive) {
 	// Initialize the shared data.
 	struct Data data = {
-		.pusher_mutex = sema_create(1, positive),
+		.pusher_mutex = sema_create_named("pusher_mutex", 1, positive),
 		.ingredient_counts = { 0 },
 		.already_pushed = { false },
-		.next = { 0 }
+		.next = { { 0 } }
 	};
-	for (size_t i = 0; i < N_INGREDIENTS; i++) {
-		data.ingredients[i] = sema_create(0, positive);
-		data.push_ingredients[i] = sema_create(0, positive);
-	}
-	for (size_t i = 0; i < N_ROLES; i++) {
-		data.next_mutex[i] = sema_create(1, positive);
-	}
-	buf_init(&data.log, N_INGREDIENTS * 4);
+	sema_array_init(&data.ingredients, "ingredients", N_INGREDIENTS, 0,
+			positive);
+	sema_array_init(&data.push_ingredients, "push_ingredients", N_INGREDIENTS,
+			0, positive);
+	sema_array_init(&data.next_mutex, "next_mutex", N_ROLES, 1, positive);
+	buf_init_events(&data.log, N_INGREDIENTS * 4);
 
 	// Create and run threads.
-	pthread_t threads[N_THREADS];
+	struct Group group;
+	group_init(&group);
 	for (size_t i = 0; i < N_INGREDIENTS; i++) {
-		pthread_create(&threads[i], NULL, run_agent, &data);
-		pthread_create(&threads[N_INGREDIENTS+i], NULL, run_smoker, &data);
-		pthread_create(&threads[N_INGREDIENTS*2+i], NULL, run_pusher, &data);
-	}
-	for (size_t i = 0; i < N_THREADS; i++) {
-		pthread_join(threads[i], NULL);
+		group_spawn(&group, run_agent, &data);
+		group_spawn(&group, run_smoker, &data);
+		group_spawn(&group, run_pusher, &data);
 	}
+	group_join(&group);
 
 	// Check for success.
 	bool success = true;
@@ -160,19 +166,15 @@ bool problem_16(bool positive) {
 		success &= counts[i] == 0;
 		success &= data.ingredient_counts[i] == 0;
 		success &= data.already_pushed[i] == true;
-		success &= data.next[i] == N_INGREDIENTS;
+		success &= data.next[i].value == N_INGREDIENTS;
 	}
 	success &= smoked == N_INGREDIENTS;
 
 	// Clean up.
 	sema_destroy(data.pusher_mutex);
-	for (size_t i = 0; i < N_INGREDIENTS; i++) {
-		sema_destroy(data.ingredients[i]);
-		sema_destroy(data.push_ingredients[i]);
-	}
-	for (size_t i = 0; i < N_ROLES; i++) {
-		sema_destroy(data.next_mutex[i]);
-	}
+	sema_array_destroy(&data.ingredients);
+	sema_array_destroy(&data.push_ingredients);
+	sema_array_destroy(&data.next_mutex);
 	buf_free(&data.log);
 
 	return success;
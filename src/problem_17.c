@@ -1,22 +1,32 @@
 // Copyright 2016 Mitchell Kember. Subject to the MIT License.
 
 #include "buffer.h"
+#include "pool.h"
 #include "problems.h"
 #include "semaphore.h"
 
-#include <pthread.h>
+#include <limits.h>
 #include <stddef.h>
 
+// Default sizes of the problem, which can be changed at runtime.
+static int n_savages = 9;
+static int n_servings_in_pot = 12;
+static int n_pot_refills = 5;
+
 #define N_COOKS 1
-#define N_SAVAGES 9
-#define N_THREADS (N_COOKS + N_SAVAGES)
+#define N_THREADS (N_COOKS + n_savages)
 
-#define N_SERVINGS_IN_POT 12
-#define N_POT_REFILLS 5
-#define N_TOTAL_SERVINGS (N_SERVINGS_IN_POT * N_POT_REFILLS)
+#define N_TOTAL_SERVINGS (n_servings_in_pot * n_pot_refills)
 
 const char *const problem_17_name = "Dining savages";
 
+const struct ProblemParam problem_17_params[] = {
+	{ "savages", &n_savages, 1, PROBLEM_PARAM_MAX, 1, NULL, NULL },
+	{ "servings", &n_servings_in_pot, 1, PROBLEM_PARAM_MAX, 1, NULL, NULL },
+	{ "refills", &n_pot_refills, 1, UCHAR_MAX, 1, NULL, NULL },
+	{ NULL, NULL, 0, 0, 0, NULL, NULL }
+};
+
 struct Data {
 	Semaphore mutex;
 	Semaphore empty_pot;
@@ -29,24 +39,29 @@ struct Data {
 static void *run_cook(void *ptr) {
 	struct Data *d = ptr;
 
-	for (int i = 0; i < N_POT_REFILLS; i++) {
+	for (int i = 0; i < n_pot_refills; i++) {
 		sema_wait(d->empty_pot);
-		d->servings = N_SERVINGS_IN_POT;
+		d->servings = n_servings_in_pot;
 		buf_push(&d->log, 'C');
+		// The savage that signaled 'empty_pot' holds the mutex on our behalf,
+		// so we can set this here. Waiting for the mutex after the last refill
+		// instead deadlocks if the savages empty the pot before we get it.
+		if (i == n_pot_refills - 1) {
+			d->finished = true;
+		}
 		sema_signal(d->full_pot);
 	}
 
-	sema_wait(d->mutex);
-	d->finished = true;
-	sema_signal(d->mutex);
-
 	return NULL;
 }
 
 static void *run_savage(void *ptr) {
 	struct Data *d = ptr;
 
-	for (;;) {
+	// No savage can eat more than all the servings, so stopping there changes
+	// nothing with semaphores, but without them it keeps savages from spinning
+	// until the cook finishes, which takes a long time with many savages.
+	for (int i = 0; i < N_TOTAL_SERVINGS; i++) {
 		sema_wait(d->mutex);
 		if (d->servings == 0) {
 			if (d->finished) {
@@ -67,34 +82,33 @@ static void *run_savage(void *ptr) {
 bool problem_17(bool positive) {
 	// Initialize the shared data.
 	struct Data data = {
-		.mutex = sema_create(1, positive),
-		.empty_pot = sema_create(0, positive),
-		.full_pot = sema_create(0, positive),
+		.mutex = sema_create_named("mutex", 1, positive),
+		.empty_pot = sema_create_named("empty_pot", 0, positive),
+		.full_pot = sema_create_named("full_pot", 0, positive),
 		.servings = 0,
 		.finished = false
 	};
-	buf_init(&data.log, N_POT_REFILLS + N_TOTAL_SERVINGS);
+	buf_init_events(&data.log, n_pot_refills + N_TOTAL_SERVINGS);
 
 	// Create and run threads.
-	pthread_t threads[N_THREADS];
-	for (size_t i = 0; i < N_COOKS; i++) {
-		pthread_create(&threads[i], NULL, run_cook, &data);
-	}
-	for (size_t i = N_COOKS; i < N_THREADS; i++) {
-		pthread_create(&threads[i], NULL, run_savage, &data);
+	struct Group group;
+	group_init(&group);
+	for (int i = 0; i < N_COOKS; i++) {
+		group_spawn(&group, run_cook, &data);
 	}
-	for (size_t i = 0; i < N_THREADS; i++) {
-		pthread_join(threads[i], NULL);
+	for (int i = N_COOKS; i < N_THREADS; i++) {
+		group_spawn(&group, run_savage, &data);
 	}
+	group_join(&group);
 
 	// Check for success.
 	bool success = true;
 	int servings = 0;
-	for (size_t i = 0; i < N_POT_REFILLS + N_TOTAL_SERVINGS; i++) {
+	for (int i = 0; i < n_pot_refills + N_TOTAL_SERVINGS; i++) {
 		unsigned char c = buf_read(&data.log, i);
 		if (c == 'C') {
 			success &= servings == 0;
-			servings = N_SERVINGS_IN_POT;
+			servings = n_servings_in_pot;
 		} else if (c == 'S') {
 			success &= servings > 0;
 			servings--;
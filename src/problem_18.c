@@ -1,29 +1,41 @@
 // Copyright 2016 Mitchell Kember. Subject to the MIT License.
 
+#include "arena.h"
 #include "buffer.h"
+#include "metrics.h"
+#include "pool.h"
 #include "problems.h"
 #include "semaphore.h"
 
-#include <pthread.h>
 #include <stdatomic.h>
 #include <stddef.h>
+#include <stdlib.h>
 
-#define N_CHAIRS 5
-#define N_CUSTOMERS 10
-#define N_THREADS (N_CUSTOMERS + 1)
+// Default sizes of the problem, which can be changed at runtime.
+static int n_chairs = 5;
+static int n_customers = 10;
+
+#define N_THREADS (n_customers + 1)
 
 const char *const problem_18_name = "Barbershop problem";
 
+const struct ProblemParam problem_18_params[] = {
+	{ "chairs", &n_chairs, 1, PROBLEM_PARAM_MAX, 1, NULL, NULL },
+	{ "customers", &n_customers, 1, PROBLEM_PARAM_MAX, 1, NULL, NULL },
+	{ NULL, NULL, 0, 0, 0, NULL, NULL }
+};
+
 struct Data {
 	Semaphore mutex;
 	Semaphore barber_ready;
 	Semaphore customer_ready;
 	Semaphore barber_done;
 	Semaphore customer_done;
-	atomic_uchar next_number;
+	atomic_uint next_number;
 	atomic_int customers_left;
+	atomic_bool closing;
 	int n_waiting;
-	unsigned char current_customer;
+	unsigned current_customer;
 	struct Buffer log;
 };
 
@@ -39,9 +51,12 @@ static void *run_barber(void *ptr) {
 		sema_signal(d->mutex);
 
 		sema_wait(d->customer_ready);
+		if (d->closing) {
+			break;
+		}
 		sema_signal(d->barber_ready);
-		buf_push2(&d->log, 'B', d->current_customer);
 		sema_wait(d->customer_done);
+		buf_push_id(&d->log, 'B', d->current_customer);
 		sema_signal(d->barber_done);
 	}
 
@@ -51,28 +66,29 @@ static void *run_barber(void *ptr) {
 static void *run_customer(void *ptr) {
 	struct Data *d = ptr;
 
-	unsigned char n = d->next_number++;
+	unsigned n = d->next_number++;
+	buf_push_id(&d->log, 'E', n);
 
 	sema_wait(d->mutex);
-	if (d->n_waiting < N_CHAIRS) {
+	if (d->n_waiting < n_chairs) {
 		d->n_waiting++;
 		sema_signal(d->mutex);
 
 		sema_signal(d->customer_ready);
-		d->current_customer = n;
 		sema_wait(d->barber_ready);
 
 		sema_wait(d->mutex);
 		d->n_waiting--;
 		sema_signal(d->mutex);
 
-		buf_push2(&d->log, 'C', n);
+		d->current_customer = n;
+		buf_push_id(&d->log, 'C', n);
 
 		sema_signal(d->customer_done);
 		sema_wait(d->barber_done);
 
 	} else {
-		buf_push2(&d->log, 'L', n);
+		buf_push_id(&d->log, 'L', n);
 		sema_signal(d->mutex);
 	}
 
@@ -83,42 +99,67 @@ static void *run_customer(void *ptr) {
 bool problem_18(bool positive) {
 	// Initialize the shared data.
 	struct Data data = {
-		.mutex = sema_create(1, positive),
-		.barber_ready = sema_create(0, positive),
-		.customer_ready = sema_create(0, positive),
-		.barber_done = sema_create(0, positive),
-		.customer_done = sema_create(0, positive),
+		.mutex = sema_create_named("mutex", 1, positive),
+		.barber_ready = sema_create_named("barber_ready", 0, positive),
+		.customer_ready = sema_create_named("customer_ready", 0, positive),
+		.barber_done = sema_create_named("barber_done", 0, positive),
+		.customer_done = sema_create_named("customer_done", 0, positive),
 		.next_number = 0,
-		.customers_left = N_CUSTOMERS,
+		.customers_left = n_customers,
+		.closing = false,
 		.current_customer = 0
 	};
-	buf_init(&data.log, N_CUSTOMERS * 4);
+	buf_init_events(&data.log, (size_t)n_customers * 9);
 
 	// Create and run threads.
-	pthread_t threads[N_THREADS];
-	pthread_create(&threads[0], NULL, run_barber, &data);
-	for (size_t i = 1; i < N_THREADS; i++) {
-		pthread_create(&threads[i], NULL, run_customer, &data);
+	struct Group barber, customers;
+	group_init(&barber);
+	group_init(&customers);
+	group_spawn(&barber, run_barber, &data);
+	for (int i = 1; i < N_THREADS; i++) {
+		group_spawn(&customers, run_customer, &data);
 	}
+	group_start(&barber);
+	group_join(&customers);
+
+	// The barber may have checked 'customers_left' just before the last
+	// customer left, so wake it up one more time to let it go home.
+	data.closing = true;
+	sema_signal(data.customer_ready);
+	group_join(&barber);
 
 	// Check for success.
 	bool success = true;
 	size_t haircuts = 0;
-	enum { NONE, LEAVE, READY, CUT } state[N_CUSTOMERS];
-	for (size_t i = 0; i < data.log.len; i += 2) {
+	enum State { NONE, ENTER, LEAVE, READY, CUT };
+	bool state_in_arena, entered_in_arena;
+	enum State *state =
+		arena_calloc((size_t)n_customers, sizeof *state, &state_in_arena);
+	long long *entered = arena_calloc(
+			(size_t)n_customers, sizeof *entered, &entered_in_arena);
+	for (size_t i = 0; i < buf_len(&data.log); i += 3) {
 		unsigned char c1 = buf_read(&data.log, i);
-		unsigned char c2 = buf_read(&data.log, i + 1);
-		if (c2 >= N_CUSTOMERS) {
+		unsigned c2 = buf_read_id(&data.log, i + 1);
+		if (c2 >= (unsigned)n_customers) {
 			success = false;
 			break;
 		}
 
-		if (c1 == 'L') {
+		if (c1 == 'E') {
 			success &= state[c2] == NONE;
+			state[c2] = ENTER;
+			entered[c2] = buf_time(&data.log, i);
+		} else if (c1 == 'L') {
+			success &= state[c2] == ENTER;
 			state[c2] = LEAVE;
 		} else if (c1 == 'C') {
-			success &= state[c2] == NONE;
+			success &= state[c2] == ENTER;
 			state[c2] = READY;
+			// Record how long the customer waited for the barber.
+			if (positive) {
+				metric_record("customer wait",
+						buf_time(&data.log, i) - entered[c2]);
+			}
 		} else if (c1 == 'B') {
 			success &= state[c2] == READY;
 			state[c2] = CUT;
@@ -128,16 +169,18 @@ bool problem_18(bool positive) {
 			break;
 		}
 	}
-	success &= haircuts <= N_CUSTOMERS;
+	success &= haircuts <= (size_t)n_customers;
 	success &= data.n_waiting == 0;
 
 	// Clean up.
-	// sema_destroy(data.mutex);
-	// sema_destroy(data.barber_ready);
-	// sema_destroy(data.customer_ready);
-	// sema_destroy(data.barber_done);
-	// sema_destroy(data.customer_done);
+	sema_destroy(data.mutex);
+	sema_destroy(data.barber_ready);
+	sema_destroy(data.customer_ready);
+	sema_destroy(data.barber_done);
+	sema_destroy(data.customer_done);
 	buf_free(&data.log);
+	arena_free(state, state_in_arena);
+	arena_free(entered, entered_in_arena);
 
 	return success;
 }
@@ -0,0 +1,81 @@
+// Copyright 2016 Mitchell Kember. Subject to the MIT License.
+
+#include "buffer.h"
+#include "pool.h"
+#include "problems.h"
+#include "semaphore.h"
+
+#include <stddef.h>
+
+// Default sizes of the problem, which can be changed at runtime.
+static int n_threads = 10;
+
+const char *const problem_19_name = "Batched barrier";
+
+const struct ProblemParam problem_19_params[] = {
+	{ "threads", &n_threads, 1, PROBLEM_PARAM_MAX, 1, NULL, NULL },
+	{ NULL, NULL, 0, 0, 0, NULL, NULL }
+};
+
+// Instead of counting arrivals under a mutex, a coordinator collects one permit
+// from each thread with a single 'sema_wait_n' and then opens the turnstile
+// for all of them with a single 'sema_signal_n'.
+struct Data {
+	Semaphore arrived;
+	Semaphore turnstile;
+	struct Buffer log;
+};
+
+static void *run(void *ptr) {
+	struct Data *d = ptr;
+
+	buf_push(&d->log, '0');
+	sema_signal(d->arrived);
+	sema_wait(d->turnstile);
+	buf_push(&d->log, '1');
+
+	return NULL;
+}
+
+static void *run_coordinator(void *ptr) {
+	struct Data *d = ptr;
+
+	sema_wait_n(d->arrived, n_threads);
+	sema_signal_n(d->turnstile, n_threads);
+
+	return NULL;
+}
+
+bool problem_19(bool positive) {
+	// Initialize the shared data.
+	struct Data data = {
+		.arrived = sema_create_named("arrived", 0, positive),
+		.turnstile = sema_create_named("turnstile", 0, positive)
+	};
+	buf_init_events(&data.log, n_threads * 2);
+
+	// Create and run threads.
+	struct Group group;
+	group_init(&group);
+	group_spawn(&group, run_coordinator, &data);
+	for (int i = 0; i < n_threads; i++) {
+		group_spawn(&group, run, &data);
+	}
+	group_join(&group);
+
+	// Check for success.
+	bool success = true;
+	for (int i = 0; i < n_threads; i++) {
+		success &= buf_read(&data.log, i) == '0';
+	}
+	for (int i = n_threads; i < n_threads * 2; i++) {
+		success &= buf_read(&data.log, i) == '1';
+	}
+
+	// Clean up.
+	sema_destroy(data.arrived);
+	sema_destroy(data.turnstile);
+	buf_free(&data.log);
+
+	return success;
+}
@@ -0,0 +1,91 @@
+// Copyright 2016 Mitchell Kember. Subject to the MIT License.
+
+#include "buffer.h"
+#include "pool.h"
+#include "problems.h"
+#include "semaphore.h"
+
+#include <limits.h>
+#include <stddef.h>
+
+// Default sizes of the problem, which can be changed at runtime.
+static int n_threads = 10;
+static int n_iterations = 3;
+
+const char *const problem_20_name = "Preloaded turnstile";
+
+const struct ProblemParam problem_20_params[] = {
+	{ "threads", &n_threads, 1, PROBLEM_PARAM_MAX, 1, NULL, NULL },
+	{ "iterations", &n_iterations, 1, UCHAR_MAX, 1, NULL, NULL },
+	{ NULL, NULL, 0, 0, 0, NULL, NULL }
+};
+
+struct Data {
+	Semaphore mutex;
+	Semaphore turnstile1;
+	Semaphore turnstile2;
+	int count;
+	struct Buffer log;
+};
+
+static void *run(void *ptr) {
+	struct Data *d = ptr;
+
+	for (int i = 0; i < n_iterations; i++) {
+		buf_push(&d->log, (unsigned char)i);
+
+		sema_wait(d->mutex);
+		d->count++;
+		if (d->count == n_threads) {
+			sema_signal_n(d->turnstile1, n_threads);
+		}
+		sema_signal(d->mutex);
+		sema_wait(d->turnstile1);
+
+		sema_wait(d->mutex);
+		d->count--;
+		if (d->count == 0) {
+			sema_signal_n(d->turnstile2, n_threads);
+		}
+		sema_signal(d->mutex);
+		sema_wait(d->turnstile2);
+	}
+
+	return NULL;
+}
+
+bool problem_20(bool positive) {
+	// Initialize the shared data.
+	struct Data data = {
+		.mutex = sema_create_named("mutex", 1, positive),
+		.turnstile1 = sema_create_named("turnstile1", 0, positive),
+		.turnstile2 = sema_create_named("turnstile2", 0, positive),
+		.count = 0
+	};
+	buf_init_events(&data.log, n_threads * n_iterations);
+
+	// Create and run threads.
+	struct Group group;
+	group_init(&group);
+	for (int i = 0; i < n_threads; i++) {
+		group_spawn(&group, run, &data);
+	}
+	group_join(&group);
+
+	// Check for success.
+	bool success = true;
+	for (int i = 0; i < n_iterations; i++) {
+		for (int j = 0; j < n_threads; j++) {
+			size_t index = i * n_threads + j;
+			success &= buf_read(&data.log, index) == i;
+		}
+	}
+
+	// Clean up.
+	sema_destroy(data.mutex);
+	sema_destroy(data.turnstile1);
+	sema_destroy(data.turnstile2);
+	buf_free(&data.log);
+
+	return success;
+}
@@ -2,7 +2,13 @@
 
 #include "problems.h"
 
+#include "util.h"
+
 #include <stddef.h>
+#include <string.h>
+
+// Maximum length of a parameter key or value in a setting.
+#define MAX_KEY_LEN 31
 
 bool problem_in_range(int n) {
 	return n >= 1 && n <= N_PROBLEMS;
@@ -28,6 +34,8 @@ const char *get_problem_name(int n) {
 	case 16: return problem_16_name;
 	case 17: return problem_17_name;
 	case 18: return problem_18_name;
+	case 19: return problem_19_name;
+	case 20: return problem_20_name;
 	default: return NULL;
 	}
 }
@@ -52,6 +60,138 @@ ProblemFn get_problem_function(int n) {
 	case 16: return problem_16;
 	case 17: return problem_17;
 	case 18: return problem_18;
+	case 19: return problem_19;
+	case 20: return problem_20;
+	default: return NULL;
+	}
+}
+
+const struct ProblemParam *get_problem_params(int n) {
+	switch (n) {
+	case  3: return problem_03_params;
+	case  4: return problem_04_params;
+	case  5: return problem_05_params;
+	case  6: return problem_06_params;
+	case  7: return problem_07_params;
+	case  8: return problem_08_params;
+	case  9: return problem_09_params;
+	case 10: return problem_10_params;
+	case 11: return problem_11_params;
+	case 12: return problem_12_params;
+	case 13: return problem_13_params;
+	case 14: return problem_14_params;
+	case 17: return problem_17_params;
+	case 18: return problem_18_params;
+	case 19: return problem_19_params;
+	case 20: return problem_20_params;
 	default: return NULL;
 	}
 }
+
+// Sets the parameter 'key' of problem 'n' to 'value' if it has one by that
+// name. Returns 1 if it was set, 0 if there is no such parameter, and -1 (after
+// printing an error message) if the value is out of range.
+static int set_param(int n, const char *key, int value) {
+	const struct ProblemParam *p = get_problem_params(n);
+	for (; p && p->key; p++) {
+		if (strcmp(p->key, key) != 0) {
+			continue;
+		}
+		if (value < p->min || value > p->max) {
+			printf_error("%s=%d: out of range for problem %d (should be "
+					"between %d and %d)", key, value, n, p->min, p->max);
+			return -1;
+		}
+		if ((value - p->min) % p->step != 0) {
+			printf_error("%s=%d: not allowed for problem %d (should be %d "
+					"plus a multiple of %d)", key, value, n, p->min, p->step);
+			return -1;
+		}
+		*p->value = value;
+		return 1;
+	}
+	return 0;
+}
+
+// Returns the key of the parameter of problem 'n' whose value is 'value'.
+static const char *key_of(int n, const int *value) {
+	const struct ProblemParam *p = get_problem_params(n);
+	while (p->value != value) {
+		p++;
+	}
+	return p->key;
+}
+
+// Checks that no parameter of problem 'n' exceeds the limit given by its
+// 'at_most' and 'plus' fields. Prints an error message and returns false if one
+// does.
+static bool check_params(int n) {
+	const struct ProblemParam *p = get_problem_params(n);
+	for (; p && p->key; p++) {
+		if (!p->at_most) {
+			continue;
+		}
+		int limit = *p->at_most + (p->plus ? *p->plus : 0);
+		if (*p->value <= limit) {
+			continue;
+		}
+		if (p->plus) {
+			printf_error("%s=%d: must be at most %s + %s (%d) for problem %d",
+					p->key, *p->value, key_of(n, p->at_most),
+					key_of(n, p->plus), limit, n);
+		} else {
+			printf_error("%s=%d: must be at most %s (%d) for problem %d",
+					p->key, *p->value, key_of(n, p->at_most), limit, n);
+		}
+		return false;
+	}
+	return true;
+}
+
+bool set_problem_params(int n, const char *settings) {
+	const int first = n == 0 ? 1 : n;
+	const int last = n == 0 ? N_PROBLEMS : n;
+	for (const char *pair = settings; *pair; ) {
+		size_t len = strcspn(pair, ",");
+		const char *eq = memchr(pair, '=', len);
+		size_t key_len = eq ? (size_t)(eq - pair) : 0;
+		size_t value_len = eq ? len - key_len - 1 : 0;
+		if (key_len == 0 || key_len > MAX_KEY_LEN || value_len > MAX_KEY_LEN) {
+			printf_error("%.*s: should be KEY=VALUE", (int)len, pair);
+			return false;
+		}
+		char key[MAX_KEY_LEN + 1];
+		char value_str[MAX_KEY_LEN + 1];
+		memcpy(key, pair, key_len);
+		key[key_len] = '\0';
+		memcpy(value_str, eq + 1, value_len);
+		value_str[value_len] = '\0';
+		int value;
+		if (!parse_int(&value, value_str)) {
+			return false;
+		}
+		int n_set = 0;
+		for (int i = first; i <= last; i++) {
+			int result = set_param(i, key, value);
+			if (result < 0) {
+				return false;
+			}
+			n_set += result;
+		}
+		if (n_set == 0) {
+			if (n == 0) {
+				printf_error("%s: no problem has this parameter", key);
+			} else {
+				printf_error("%s: problem %d has no such parameter", key, n);
+			}
+			return false;
+		}
+		pair += pair[len] ? len + 1 : len;
+	}
+	for (int i = first; i <= last; i++) {
+		if (!check_params(i)) {
+			return false;
+		}
+	}
+	return true;
+}
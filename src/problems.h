@@ -6,13 +6,31 @@
 #include <stdbool.h>
 
 // Number of exercise problems done so far.
-#define N_PROBLEMS 18
+#define N_PROBLEMS 20
 
 // A function that executes an exercise problem, returning true on success. If
 // 'positive' is true, then it uses real semaphores. Otherwise, it uses dummy
 // semaphores (that way we can test for failure with semaphores disabled).
 typedef bool (*ProblemFn)(bool positive);
 
+// Largest value of a problem parameter. Problems log the numbers of their
+// threads and items with 'buf_push_id', so it cannot be more than BUF_MAX_ID.
+#define PROBLEM_PARAM_MAX 65535
+
+// A size of an exercise problem that can be changed at runtime, such as its
+// number of threads. Problems that have them define a table of them, ending
+// with an entry whose key is null. The values are only changed before any
+// tests run, so problems read them without synchronization.
+struct ProblemParam {
+	const char *key;     // name used to set it
+	int *value;          // current value, initially the default
+	int min;
+	int max;
+	int step;            // values go up from 'min' in steps of this
+	const int *at_most;  // another parameter it cannot exceed, or null
+	const int *plus;     // a parameter added to 'at_most', or null
+};
+
 // Declarations for exercise problem names.
 extern const char *const problem_01_name;
 extern const char *const problem_02_name;
@@ -32,6 +50,26 @@ extern const char *const problem_15_name;
 extern const char *const problem_16_name;
 extern const char *const problem_17_name;
 extern const char *const problem_18_name;
+extern const char *const problem_19_name;
+extern const char *const problem_20_name;
+
+// Declarations for exercise problem parameters.
+extern const struct ProblemParam problem_03_params[];
+extern const struct ProblemParam problem_04_params[];
+extern const struct ProblemParam problem_05_params[];
+extern const struct ProblemParam problem_06_params[];
+extern const struct ProblemParam problem_07_params[];
+extern const struct ProblemParam problem_08_params[];
+extern const struct ProblemParam problem_09_params[];
+extern const struct ProblemParam problem_10_params[];
+extern const struct ProblemParam problem_11_params[];
+extern const struct ProblemParam problem_12_params[];
+extern const struct ProblemParam problem_13_params[];
+extern const struct ProblemParam problem_14_params[];
+extern const struct ProblemParam problem_17_params[];
+extern const struct ProblemParam problem_18_params[];
+extern const struct ProblemParam problem_19_params[];
+extern const struct ProblemParam problem_20_params[];
 
 // Prototypes for exercise problem functions.
 bool problem_01(bool);
@@ -52,6 +90,8 @@ bool problem_15(bool);
 bool problem_16(bool);
 bool problem_17(bool);
 bool problem_18(bool);
+bool problem_19(bool);
+bool problem_20(bool);
 
 // Returns true if there is an exercise problem numbered 'n'.
 bool problem_in_range(int n);
@@ -62,4 +102,14 @@ const char *get_problem_name(int n);
 // Returns the function pointer for the exercise problem numbered 'n'.
 ProblemFn get_problem_function(int n);
 
+// Returns the parameter table of the exercise problem numbered 'n', or null if
+// it has no parameters.
+const struct ProblemParam *get_problem_params(int n);
+
+// Sets parameters of the exercise problem numbered 'n' from 'settings', a
+// comma-separated list of KEY=VALUE pairs. If 'n' is zero, sets them for every
+// problem that has the key instead. If there was an error, prints an error
+// message and returns false.
+bool set_problem_params(int n, const char *settings);
+
 #endif
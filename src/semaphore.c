@@ -2,45 +2,1003 @@
 
 #include "semaphore.h"
 
-#include <unistd.h>
+#include "arena.h"
+#include "eventfd.h"
+#include "futex.h"
+#include "util.h"
 
-Semaphore sema_create(long value, bool real_semaphore) {
-	if (real_semaphore) {
-		return dispatch_semaphore_create(value);
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+static_assert(sizeof(atomic_int) == 4, "futex words must be 32 bits");
+static_assert(SEMA_WAIT_ANY_MAX < EFD_POLL_MAX, "too many semaphores to poll");
+
+// Backend for new semaphores.
+static enum SemaBackend backend = SEMA_FUTEX;
+
+// Number of spin iterations to allow on top of twice the moving average, so
+// that semaphores whose average has decayed to zero still probe occasionally.
+#define SPIN_PROBE 16
+
+// Maximum number of spin iterations in 'sema_wait'. Zero disables spinning.
+static int spin_limit = 0;
+
+// Maximum time 'sema_wait' blocks for, in nanoseconds. Zero means no limit.
+static long long wait_limit_ns = 0;
+
+// Set when the calling thread destroys a semaphore that timed out.
+static _Thread_local bool destroyed_timed_out = false;
+
+// Counters for the spin report.
+static atomic_ulong spun_count = 0;
+static atomic_ulong parked_count = 0;
+
+// Number of per-thread statistics slots. Each slot caches the counters for one
+// semaphore, and a thread evicts (folds) a slot when another semaphore maps to
+// it, so this only needs to cover the semaphores a thread uses at once.
+#define N_STATS_SLOTS 16
+
+// Per-semaphore statistics. Threads fold their private counters into this with
+// atomic operations, which only happens on eviction, thread exit, and destroy.
+struct StatsBlock {
+	const char *name;
+	int scope;
+	atomic_ulong waits;
+	atomic_ulong blocked_waits;
+	atomic_ulong signals;
+	atomic_ulong wakeups;
+	atomic_int peak_waiters;
+	atomic_llong blocked_ns;
+};
+
+// A thread's private counters for one semaphore.
+struct StatsSlot {
+	struct StatsBlock *block;
+	unsigned long waits;
+	unsigned long blocked_waits;
+	unsigned long signals;
+	unsigned long wakeups;
+	int peak_waiters;
+	long long blocked_ns;
+};
+
+// An entry in the statistics registry, keyed by scope and name.
+struct StatsEntry {
+	int scope;
+	struct SemaStats stats;
+	struct StatsEntry *next;
+};
+
+// Whether new semaphores collect statistics.
+static bool stats_enabled = false;
+
+// Scopes recorded for semaphores created by this thread.
+static _Thread_local int stats_scope = 0;
+static _Thread_local int watch_scope = 0;
+
+// This thread's statistics slots, and whether they are registered to be folded
+// when the thread exits.
+static _Thread_local struct StatsSlot stats_slots[N_STATS_SLOTS];
+static _Thread_local bool stats_slots_registered = false;
+static pthread_key_t stats_key;
+static pthread_once_t stats_key_once = PTHREAD_ONCE_INIT;
+
+// The statistics registry, as a list in insertion order.
+static struct StatsEntry *registry_head = NULL;
+static struct StatsEntry **registry_tail = &registry_head;
+static pthread_mutex_t registry_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// What the deadlock watchdog knows about a watched semaphore.
+struct WatchInfo {
+	const char *name;
+	int scope;
+	unsigned epoch;  // epoch of the scope when the semaphore was created
+};
+
+// A thread blocked on a watched semaphore. It lives on the waiting thread's
+// stack and is linked into the blocked list while the thread waits.
+struct BlockedThread {
+	Semaphore sem;
+	atomic_int *word;  // futex word the thread sleeps on, or null for eventfds
+	int wake_fd;       // eventfd the thread also polls, or -1 for futexes
+	const char *role;
+	int index;
+	struct BlockedThread *prev;
+	struct BlockedThread *next;
+};
+
+// Whether new semaphores are watched for deadlocks.
+static bool watch_enabled = false;
+
+// Number of operations on watched semaphores in each scope, and the number of
+// times each scope has been aborted. Semaphores created in an earlier epoch of
+// their scope are aborted.
+static atomic_ulong scope_activity[SEMA_WATCH_SCOPES];
+static atomic_uint scope_epochs[SEMA_WATCH_SCOPES];
+
+// Eventfd that 'sema_abort_scope' gives to when it wakes the calling thread
+// from an eventfd wait. Giving to the semaphore itself would add a permit.
+// Created on first use and closed when the thread exits.
+static _Thread_local int abort_fd = -1;
+static pthread_key_t abort_fd_key;
+static pthread_once_t abort_fd_key_once = PTHREAD_ONCE_INIT;
+
+// Role of the calling thread, for the blocked list.
+static _Thread_local const char *thread_role = NULL;
+static _Thread_local int thread_role_index = 0;
+
+// Threads blocked on watched semaphores.
+static struct BlockedThread *blocked_head = NULL;
+static pthread_mutex_t blocked_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Counts an operation on 's' as progress in its scope, if it is watched.
+static void note_activity(Semaphore s) {
+	if (s->watch) {
+		atomic_fetch_add_explicit(
+				&scope_activity[s->watch->scope], 1, memory_order_relaxed);
 	}
-	return 0;
+}
+
+// Returns true if 's' has been aborted by 'sema_abort_scope'.
+static bool aborted(Semaphore s) {
+	return s->watch && atomic_load(&scope_epochs[s->watch->scope])
+		!= s->watch->epoch;
+}
+
+// Marks 's' as timed out after a wait on it exceeded the wait limit, and aborts
+// its scope unless that is already why the wait gave up. The rest of the
+// iteration then runs as if its semaphores were dummies, like a negative test,
+// instead of every later wait also blocking until the limit.
+static void exceeded_wait_limit(Semaphore s) {
+	atomic_store_explicit(&s->timed_out, true, memory_order_relaxed);
+	if (s->watch && !aborted(s)) {
+		sema_abort_scope(s->watch->scope);
+	}
+}
+
+// Closes the abort eventfd of a thread that is exiting. The key stores the
+// descriptor plus one, since destructors are not called for null values.
+static void close_abort_fd(void *fd_plus_one) {
+	efd_close((int)(intptr_t)fd_plus_one - 1);
+}
+
+static void create_abort_fd_key(void) {
+	pthread_key_create(&abort_fd_key, close_abort_fd);
+}
+
+// Returns the calling thread's abort eventfd, creating it if necessary.
+static int get_abort_fd(void) {
+	if (abort_fd == -1) {
+		abort_fd = efd_create(0);
+		if (abort_fd == -1) {
+			printf_error("error creating abort eventfd: %s", strerror(errno));
+			exit(1);
+		}
+		pthread_once(&abort_fd_key_once, create_abort_fd_key);
+		pthread_setspecific(abort_fd_key, (void *)(intptr_t)(abort_fd + 1));
+	}
+	return abort_fd;
+}
+
+// Adds the calling thread to the blocked list as waiting on 's' (sleeping on
+// the futex word 'word', or polling eventfds if it is null), if 's' is watched.
+// Returns the eventfd that eventfd waiters must also poll to notice aborts, or
+// -1 if there is none.
+static int begin_blocked(struct BlockedThread *b, Semaphore s,
+		atomic_int *word) {
+	if (s->watch == NULL) {
+		return -1;
+	}
+	*b = (struct BlockedThread){
+		s, word, word ? -1 : get_abort_fd(), thread_role, thread_role_index,
+		NULL, NULL
+	};
+	pthread_mutex_lock(&blocked_mutex);
+	b->next = blocked_head;
+	if (blocked_head) {
+		blocked_head->prev = b;
+	}
+	blocked_head = b;
+	pthread_mutex_unlock(&blocked_mutex);
+	return b->wake_fd;
+}
+
+// Removes the calling thread from the blocked list after 'begin_blocked'.
+static void end_blocked(struct BlockedThread *b, Semaphore s) {
+	if (s->watch == NULL) {
+		return;
+	}
+	pthread_mutex_lock(&blocked_mutex);
+	if (b->prev) {
+		b->prev->next = b->next;
+	} else {
+		blocked_head = b->next;
+	}
+	if (b->next) {
+		b->next->prev = b->prev;
+	}
+	pthread_mutex_unlock(&blocked_mutex);
+	// Nothing gives to the abort eventfd once the thread is off the list, so
+	// draining it now keeps a stale abort from waking the next wait.
+	if (b->wake_fd != -1) {
+		while (efd_take(b->wake_fd));
+	}
+}
+
+// Folds the counters in 'slot' into its block and clears it.
+static void flush_slot(struct StatsSlot *slot) {
+	struct StatsBlock *b = slot->block;
+	if (b == NULL) {
+		return;
+	}
+	atomic_fetch_add_explicit(&b->waits, slot->waits, memory_order_relaxed);
+	atomic_fetch_add_explicit(
+			&b->blocked_waits, slot->blocked_waits, memory_order_relaxed);
+	atomic_fetch_add_explicit(&b->signals, slot->signals, memory_order_relaxed);
+	atomic_fetch_add_explicit(&b->wakeups, slot->wakeups, memory_order_relaxed);
+	atomic_fetch_add_explicit(
+			&b->blocked_ns, slot->blocked_ns, memory_order_relaxed);
+	int peak = atomic_load_explicit(&b->peak_waiters, memory_order_relaxed);
+	while (slot->peak_waiters > peak && !atomic_compare_exchange_weak(
+			&b->peak_waiters, &peak, slot->peak_waiters));
+	memset(slot, 0, sizeof *slot);
+}
+
+// Folds all of this thread's slots. Registered as the 'stats_key' destructor,
+// so it runs when a thread that used statistics exits.
+static void flush_thread_stats(void *slots) {
+	struct StatsSlot *s = slots;
+	for (size_t i = 0; i < N_STATS_SLOTS; i++) {
+		flush_slot(&s[i]);
+	}
+}
+
+static void create_stats_key(void) {
+	pthread_key_create(&stats_key, flush_thread_stats);
+}
+
+// Returns the calling thread's slot for the semaphore's statistics, evicting
+// whatever was there before. Returns null if 's' is not collecting them.
+static struct StatsSlot *stats_slot(Semaphore s) {
+	struct StatsBlock *b = s->stats;
+	if (b == NULL) {
+		return NULL;
+	}
+	struct StatsSlot *slot =
+		&stats_slots[((uintptr_t)b / sizeof *b) % N_STATS_SLOTS];
+	if (slot->block != b) {
+		if (!stats_slots_registered) {
+			pthread_once(&stats_key_once, create_stats_key);
+			pthread_setspecific(stats_key, stats_slots);
+			stats_slots_registered = true;
+		}
+		flush_slot(slot);
+		slot->block = b;
+	}
+	return slot;
+}
+
+// Adds the totals in 'b' to the registry entry for its scope and name.
+static void register_stats(struct StatsBlock *b) {
+	pthread_mutex_lock(&registry_mutex);
+	struct StatsEntry *e = registry_head;
+	while (e && !(e->scope == b->scope
+			&& strcmp(e->stats.name, b->name) == 0)) {
+		e = e->next;
+	}
+	if (e == NULL) {
+		e = calloc(1, sizeof *e);
+		arena_count_heap();
+		e->scope = b->scope;
+		e->stats.name = b->name;
+		*registry_tail = e;
+		registry_tail = &e->next;
+	}
+	e->stats.count++;
+	e->stats.waits += b->waits;
+	e->stats.blocked_waits += b->blocked_waits;
+	e->stats.signals += b->signals;
+	e->stats.wakeups += b->wakeups;
+	e->stats.peak_waiters = MAX(e->stats.peak_waiters, b->peak_waiters);
+	e->stats.blocked_ns += b->blocked_ns;
+	pthread_mutex_unlock(&registry_mutex);
+}
+
+// Initializes a semaphore using backend 'b'.
+static void init(struct Semaphore *s, const char *name, long value,
+		enum SemaBackend b) {
+	assert(value >= 0 && value <= INT_MAX);
+	s->fd = -1;
+	if (b == SEMA_EVENTFD) {
+		s->fd = efd_create((int)value);
+		if (s->fd == -1) {
+			printf_error("eventfd: %s", strerror(errno));
+			exit(1);
+		}
+	}
+	atomic_init(&s->value, (int)value);
+	atomic_init(&s->waiters, 0);
+	atomic_init(&s->bulk_waiters, 0);
+	atomic_init(&s->spin, 0);
+	atomic_init(&s->lock, 0);
+	atomic_init(&s->timed_out, false);
+	s->fifo = b == SEMA_FIFO;
+	s->in_arena = false;
+	s->info_in_arena = false;
+	s->stats = NULL;
+	s->head = NULL;
+	s->tail = NULL;
+	s->watch = NULL;
+	if (watch_enabled && watch_scope >= 0 && watch_scope < SEMA_WATCH_SCOPES) {
+		s->watch = arena_alloc(sizeof *s->watch, &s->info_in_arena);
+		s->watch->name = name ? name : "(unnamed)";
+		s->watch->scope = watch_scope;
+		s->watch->epoch = atomic_load(&scope_epochs[watch_scope]);
+	}
+	if (stats_enabled) {
+		s->stats = arena_alloc(sizeof *s->stats, &s->info_in_arena);
+		memset(s->stats, 0, sizeof *s->stats);
+		s->stats->name = name ? name : "(unnamed)";
+		s->stats->scope = stats_scope;
+	}
+}
+
+// Allocates a semaphore on a cache line of its own, so that semaphores
+// allocated one after another don't share lines, and initializes it.
+static Semaphore create(const char *name, long value, enum SemaBackend b) {
+	bool in_arena;
+	struct PaddedSemaphore *p = arena_alloc(sizeof *p, &in_arena);
+	init(&p->sem, name, value, b);
+	p->sem.in_arena = in_arena;
+	return &p->sem;
+}
+
+Semaphore sema_create(long value, bool real_semaphore) {
+	return sema_create_named(NULL, value, real_semaphore);
+}
+
+Semaphore sema_create_named(const char *name, long value, bool real_semaphore) {
+	return real_semaphore ? create(name, value, backend) : 0;
+}
+
+Semaphore sema_create_fifo(const char *name, long value, bool real_semaphore) {
+	return real_semaphore ? create(name, value, SEMA_FIFO) : 0;
 }
 
 void sema_destroy(Semaphore s) {
 	if (s != 0) {
-		dispatch_release(s);
+		bool in_arena = s->in_arena;
+		sema_fini(s);
+		arena_free(s, in_arena);
+	}
+}
+
+bool sema_set_backend(enum SemaBackend b) {
+	if (b == SEMA_EVENTFD && !efd_supported()) {
+		return false;
+	}
+	backend = b;
+	return true;
+}
+
+enum SemaBackend sema_get_backend(void) {
+	return backend;
+}
+
+void sema_init(struct Semaphore *s, const char *name, long value) {
+	init(s, name, value, backend);
+}
+
+void sema_fini(struct Semaphore *s) {
+	assert(s->waiters == 0);
+	if (atomic_load_explicit(&s->timed_out, memory_order_relaxed)) {
+		destroyed_timed_out = true;
+	}
+	if (s->fd != -1) {
+		efd_close(s->fd);
+	}
+	if (s->stats) {
+		// Every other thread that used the semaphore has exited or called
+		// 'sema_flush_thread_stats' before this thread synchronized with
+		// it (for example, by joining its group), so only this thread's
+		// slots can still refer to the block.
+		flush_thread_stats(stats_slots);
+		register_stats(s->stats);
+		arena_free(s->stats, s->info_in_arena);
+	}
+	if (s->watch) {
+		arena_free(s->watch, s->info_in_arena);
+	}
+}
+
+void sema_array_init(struct SemaArray *a, const char *name, size_t len,
+		long value, bool real_semaphores) {
+	a->len = len;
+	a->items = NULL;
+	a->in_arena = false;
+	if (real_semaphores) {
+		a->items = arena_alloc(len * sizeof *a->items, &a->in_arena);
+		for (size_t i = 0; i < len; i++) {
+			sema_init(&a->items[i].sem, name, value);
+		}
+	}
+}
+
+void sema_array_destroy(struct SemaArray *a) {
+	if (a->items) {
+		for (size_t i = 0; i < a->len; i++) {
+			sema_fini(&a->items[i].sem);
+		}
+		arena_free(a->items, a->in_arena);
+		a->items = NULL;
+	}
+}
+
+// A thread blocked on a FIFO semaphore. It lives on the waiting thread's stack
+// and is linked into the semaphore's queue while the thread waits.
+struct FifoWaiter {
+	atomic_int granted;       // futex word, set once the permits are given
+	int n;                    // number of permits wanted
+	struct FifoWaiter *next;  // next newer waiter
+};
+
+// Locks a FIFO semaphore. The lock word is 0 when unlocked, 1 when locked, and
+// 2 when locked with other threads possibly blocked on it.
+static void fifo_lock(Semaphore s) {
+	int c = 0;
+	if (atomic_compare_exchange_strong(&s->lock, &c, 1)) {
+		return;
+	}
+	if (c != 2) {
+		c = atomic_exchange(&s->lock, 2);
+	}
+	while (c != 0) {
+		futex_wait(&s->lock, 2, -1);
+		c = atomic_exchange(&s->lock, 2);
 	}
 }
 
+static void fifo_unlock(Semaphore s) {
+	if (atomic_fetch_sub(&s->lock, 1) != 1) {
+		atomic_store(&s->lock, 0);
+		futex_wake(&s->lock, 1);
+	}
+}
+
+// Hands permits to the waiters at the head of the queue for as long as there
+// are enough for the oldest one. Must be called with the lock held. Returns the
+// number of waiters woken up.
+static int fifo_grant(Semaphore s) {
+	int woken = 0;
+	int value = atomic_load_explicit(&s->value, memory_order_relaxed);
+	struct FifoWaiter *w;
+	while ((w = s->head) != NULL && value >= w->n) {
+		value -= w->n;
+		s->head = w->next;
+		if (s->head == NULL) {
+			s->tail = NULL;
+		}
+		// The waiter may return (and its node go away) as soon as 'granted' is
+		// set. Waking a futex word that is no longer in use is harmless.
+		atomic_store(&w->granted, 1);
+		futex_wake(&w->granted, 1);
+		woken++;
+	}
+	atomic_store_explicit(&s->value, value, memory_order_relaxed);
+	return woken;
+}
+
+// Adds 'n' permits to a FIFO semaphore and hands them out in order.
+static void fifo_signal(Semaphore s, int n) {
+	note_activity(s);
+	fifo_lock(s);
+	atomic_fetch_add_explicit(&s->value, n, memory_order_relaxed);
+	int woken = fifo_grant(s);
+	fifo_unlock(s);
+	struct StatsSlot *slot = stats_slot(s);
+	if (slot) {
+		slot->signals++;
+		slot->wakeups += woken > 0;
+	}
+}
+
+// Takes 'n' permits from a FIFO semaphore, queueing up behind any other waiters
+// for at most 'timeout_ns' nanoseconds (or indefinitely if it is negative).
+// Returns true if it got the permits.
+static bool fifo_acquire(Semaphore s, int n, long long timeout_ns) {
+	fifo_lock(s);
+	int value = atomic_load_explicit(&s->value, memory_order_relaxed);
+	if (s->head == NULL && value >= n) {
+		atomic_store_explicit(&s->value, value - n, memory_order_relaxed);
+		fifo_unlock(s);
+		return true;
+	}
+	if (timeout_ns == 0) {
+		fifo_unlock(s);
+		return false;
+	}
+	struct FifoWaiter w = { .n = n, .next = NULL };
+	atomic_init(&w.granted, 0);
+	if (s->tail) {
+		s->tail->next = &w;
+	} else {
+		s->head = &w;
+	}
+	s->tail = &w;
+	int waiters = atomic_fetch_add(&s->waiters, 1) + 1;
+	fifo_unlock(s);
+
+	struct StatsSlot *slot = stats_slot(s);
+	long long start = slot || timeout_ns > 0 ? monotonic_ns() : 0;
+	long long deadline = timeout_ns < 0 ? 0 : start + timeout_ns;
+	if (slot) {
+		slot->blocked_waits++;
+		slot->peak_waiters = MAX(slot->peak_waiters, waiters);
+	}
+	struct BlockedThread blocked;
+	begin_blocked(&blocked, s, &w.granted);
+	bool acquired = true;
+	while (!atomic_load(&w.granted)) {
+		long long remaining = -1;
+		bool give_up = aborted(s);
+		if (!give_up && timeout_ns > 0) {
+			remaining = deadline - monotonic_ns();
+			give_up = remaining <= 0;
+		}
+		if (give_up) {
+			// Leave the queue, unless the permits arrived in the meantime.
+			fifo_lock(s);
+			if (!atomic_load(&w.granted)) {
+				struct FifoWaiter **p = &s->head, *prev = NULL;
+				while (*p != &w) {
+					prev = *p;
+					p = &(*p)->next;
+				}
+				*p = w.next;
+				if (s->tail == &w) {
+					s->tail = prev;
+				}
+				// Waiters behind this one may be satisfied now.
+				fifo_grant(s);
+				acquired = false;
+			}
+			fifo_unlock(s);
+			break;
+		}
+		futex_wait(&w.granted, 0, remaining);
+	}
+	end_blocked(&blocked, s);
+	if (!acquired && aborted(s)) {
+		atomic_store_explicit(&s->timed_out, true, memory_order_relaxed);
+	}
+	atomic_fetch_sub(&s->waiters, 1);
+	if (slot) {
+		slot->blocked_ns += monotonic_ns() - start;
+	}
+	return acquired;
+}
+
 void sema_signal(Semaphore s) {
+	sema_signal_n(s, 1);
+}
+
+void sema_signal_n(Semaphore s, int n) {
+	assert(n >= 1);
+	if (s != 0 && s->fifo) {
+		fifo_signal(s, n);
+		return;
+	}
 	if (s != 0) {
-		dispatch_semaphore_signal(s);
+		note_activity(s);
+		// The increment and the load of 'waiters' are both sequentially
+		// consistent, and so are the corresponding operations in
+		// 'park_acquire'. Either the waiter sees the new value before parking,
+		// or we see the waiter and wake it up. The kernel takes care of this
+		// for eventfds, so there 'waiters' is only for statistics.
+		if (s->fd != -1) {
+			efd_give(s->fd, n);
+		} else {
+			atomic_fetch_add(&s->value, n);
+		}
+		int waiters = atomic_load(&s->waiters);
+		struct StatsSlot *slot = stats_slot(s);
+		if (slot) {
+			slot->signals++;
+			slot->wakeups += waiters > 0;
+		}
+		if (waiters > 0 && s->fd == -1) {
+			// A thread waiting for several permits might be woken instead of
+			// one that could use the ones we added, so in that case wake
+			// everyone and let them sort it out.
+			bool bulk = atomic_load(&s->bulk_waiters) > 0;
+			futex_wake(&s->value, bulk ? INT_MAX : MIN(n, waiters));
+		}
+	}
+}
+
+// Tries to take 'n' permits without blocking. Returns true on success.
+static bool try_acquire(Semaphore s, int n) {
+	if (s->fd != -1) {
+		assert(n == 1);
+		return efd_take(s->fd);
+	}
+	int value = atomic_load_explicit(&s->value, memory_order_relaxed);
+	while (value >= n) {
+		if (atomic_compare_exchange_weak(&s->value, &value, value - n)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// Spins for up to twice the semaphore's moving average (capped by the global
+// limit), then updates the average with the outcome. Returns true if it got
+// 'n' permits while spinning.
+static bool spin_acquire(Semaphore s, int n) {
+	int average8 = atomic_load_explicit(&s->spin, memory_order_relaxed);
+	int limit = MIN(spin_limit, average8 / 4 + SPIN_PROBE);
+	int i;
+	bool acquired = false;
+	for (i = 0; i < limit; i++) {
+		cpu_relax();
+		// Only attempt the CAS once the permits show up, to avoid stealing the
+		// cache line from the thread that is about to signal.
+		if (atomic_load_explicit(&s->value, memory_order_relaxed) >= n
+				&& try_acquire(s, n)) {
+			acquired = true;
+			break;
+		}
+	}
+	// A failed spin counts as zero, so the average decays on semaphores where
+	// spinning does not pay off. The average is kept in fixed point (scaled by
+	// 8) so that small differences still move it. Races on this update only
+	// lose history.
+	int sample = acquired ? i + 1 : 0;
+	atomic_store_explicit(&s->spin, average8 + sample - average8 / 8,
+			memory_order_relaxed);
+	atomic_fetch_add_explicit(acquired ? &spun_count : &parked_count, 1,
+			memory_order_relaxed);
+	return acquired;
+}
+
+// Blocks until 'n' permits are taken or 'timeout_ns' nanoseconds pass
+// (negative means forever). Returns true if it got the permits.
+static bool park_acquire(Semaphore s, int n, long long timeout_ns) {
+	struct StatsSlot *slot = stats_slot(s);
+	long long start = slot || timeout_ns >= 0 ? monotonic_ns() : 0;
+	long long deadline = timeout_ns < 0 ? 0 : start + timeout_ns;
+	bool acquired = false;
+	if (n > 1) {
+		atomic_fetch_add(&s->bulk_waiters, 1);
 	}
+	int waiters = atomic_fetch_add(&s->waiters, 1) + 1;
+	if (slot) {
+		slot->blocked_waits++;
+		slot->peak_waiters = MAX(slot->peak_waiters, waiters);
+	}
+	struct BlockedThread blocked;
+	int wake_fd = begin_blocked(&blocked, s, s->fd == -1 ? &s->value : NULL);
+	int fds[2] = { s->fd, wake_fd };
+	while (s->fd != -1) {
+		if (efd_take(s->fd)) {
+			acquired = true;
+			break;
+		}
+		if (aborted(s)) {
+			break;
+		}
+		long long remaining = -1;
+		if (timeout_ns >= 0) {
+			remaining = deadline - monotonic_ns();
+			if (remaining <= 0) {
+				break;
+			}
+		}
+		efd_poll(fds, wake_fd == -1 ? 1 : 2, remaining);
+	}
+	while (s->fd == -1) {
+		int value = atomic_load(&s->value);
+		if (value >= n) {
+			if (atomic_compare_exchange_weak(&s->value, &value, value - n)) {
+				acquired = true;
+				break;
+			}
+			continue;
+		}
+		if (aborted(s)) {
+			break;
+		}
+		long long remaining = -1;
+		if (timeout_ns >= 0) {
+			remaining = deadline - monotonic_ns();
+			if (remaining <= 0) {
+				break;
+			}
+		}
+		futex_wait(&s->value, value, remaining);
+	}
+	end_blocked(&blocked, s);
+	if (!acquired && aborted(s)) {
+		atomic_store_explicit(&s->timed_out, true, memory_order_relaxed);
+	}
+	atomic_fetch_sub(&s->waiters, 1);
+	if (n > 1) {
+		atomic_fetch_sub(&s->bulk_waiters, 1);
+	}
+	if (slot) {
+		slot->blocked_ns += monotonic_ns() - start;
+	}
+	return acquired;
 }
 
 void sema_wait(Semaphore s) {
+	sema_wait_n(s, 1);
+}
+
+// Counts a call to a wait function in the statistics for 's'.
+static void count_wait(Semaphore s) {
+	note_activity(s);
+	struct StatsSlot *slot = stats_slot(s);
+	if (slot) {
+		slot->waits++;
+	}
+}
+
+void sema_wait_n(Semaphore s, int n) {
+	assert(n >= 1);
+	if (s != 0 && s->fd != -1 && n > 1) {
+		// Eventfds in semaphore mode can only be decremented by one.
+		for (int i = 0; i < n; i++) {
+			sema_wait(s);
+		}
+		return;
+	}
+	if (s != 0 && s->fifo) {
+		count_wait(s);
+		if (!fifo_acquire(s, n, wait_limit_ns > 0 ? wait_limit_ns : -1)) {
+			exceeded_wait_limit(s);
+		}
+		return;
+	}
+	if (s != 0) {
+		count_wait(s);
+		if (try_acquire(s, n)) {
+			return;
+		}
+		if (spin_limit > 0 && s->fd == -1 && spin_acquire(s, n)) {
+			return;
+		}
+		if (!park_acquire(s, n, wait_limit_ns > 0 ? wait_limit_ns : -1)) {
+			exceeded_wait_limit(s);
+		}
+	}
+}
+
+size_t sema_wait_any(const Semaphore *sems, size_t n) {
+	assert(n >= 1 && n <= SEMA_WAIT_ANY_MAX);
+	// Rotate the starting point so that the first semaphores do not starve the
+	// others when several are available.
+	static _Thread_local size_t start = 0;
+	// One extra for the abort eventfd.
+	int fds[SEMA_WAIT_ANY_MAX + 1];
+	int n_fds = (int)n;
+	for (size_t i = 0; i < n; i++) {
+		if (sems[i] == 0) {
+			return i;
+		}
+		assert(sems[i]->fd != -1);
+		fds[i] = sems[i]->fd;
+	}
+	start = (start + 1) % n;
+	long long deadline = wait_limit_ns > 0 ? monotonic_ns() + wait_limit_ns : 0;
+	bool blocked = false;
+	struct BlockedThread b;
+	for (;;) {
+		for (size_t j = 0; j < n; j++) {
+			size_t i = (start + j) % n;
+			if (efd_take(fds[i])) {
+				count_wait(sems[i]);
+				if (blocked) {
+					end_blocked(&b, sems[0]);
+					for (size_t k = 0; k < n; k++) {
+						atomic_fetch_sub(&sems[k]->waiters, 1);
+					}
+				}
+				return i;
+			}
+		}
+		bool any_aborted = false;
+		for (size_t k = 0; k < n; k++) {
+			any_aborted |= aborted(sems[k]);
+		}
+		if (any_aborted) {
+			break;
+		}
+		long long remaining = -1;
+		if (deadline != 0) {
+			remaining = deadline - monotonic_ns();
+			if (remaining <= 0) {
+				break;
+			}
+		}
+		if (!blocked) {
+			// Count this thread as a waiter on all of them, so that signals
+			// are recorded as wakeups and destroying any of them is caught.
+			for (size_t k = 0; k < n; k++) {
+				atomic_fetch_add(&sems[k]->waiters, 1);
+			}
+			int wake_fd = begin_blocked(&b, sems[0], NULL);
+			if (wake_fd != -1) {
+				fds[n_fds++] = wake_fd;
+			}
+			blocked = true;
+			// Check again before sleeping, in case an abort came before this
+			// thread was on the blocked list.
+			continue;
+		}
+		efd_poll(fds, n_fds, remaining);
+	}
+	if (blocked) {
+		end_blocked(&b, sems[0]);
+	}
+	for (size_t k = 0; k < n; k++) {
+		if (blocked) {
+			atomic_fetch_sub(&sems[k]->waiters, 1);
+		}
+		exceeded_wait_limit(sems[k]);
+	}
+	return 0;
+}
+
+int sema_fd(Semaphore s) {
+	return s != 0 ? s->fd : -1;
+}
+
+enum SemaStatus sema_try_wait(Semaphore s) {
+	if (s != 0) {
+		count_wait(s);
+		if (!(s->fifo ? fifo_acquire(s, 1, 0) : try_acquire(s, 1))) {
+			return SEMA_TIMED_OUT;
+		}
+	}
+	return SEMA_ACQUIRED;
+}
+
+enum SemaStatus sema_wait_timeout(Semaphore s, long long timeout_ns) {
+	assert(timeout_ns >= 0);
 	if (s != 0) {
-		dispatch_semaphore_wait(s, DISPATCH_TIME_FOREVER);
+		count_wait(s);
+		if (s->fifo) {
+			if (!fifo_acquire(s, 1, timeout_ns)) {
+				return SEMA_TIMED_OUT;
+			}
+		} else if (!try_acquire(s, 1)
+				&& (timeout_ns == 0 || !park_acquire(s, 1, timeout_ns))) {
+			return SEMA_TIMED_OUT;
+		}
+	}
+	return SEMA_ACQUIRED;
+}
+
+void sema_set_wait_limit(long long limit_ns) {
+	assert(limit_ns >= 0);
+	wait_limit_ns = limit_ns;
+	if (limit_ns > 0) {
+		watch_enabled = true;
+	}
+}
+
+bool sema_check_timeouts(void) {
+	bool timed_out = destroyed_timed_out;
+	destroyed_timed_out = false;
+	return timed_out;
+}
+
+void sema_set_spin_limit(int limit) {
+	assert(limit >= 0);
+	spin_limit = limit;
+}
+
+int sema_get_spin_limit(void) {
+	return spin_limit;
+}
+
+struct SpinCounts sema_spin_counts(void) {
+	return (struct SpinCounts){
+		.spun = atomic_load(&spun_count),
+		.parked = atomic_load(&parked_count)
+	};
+}
+
+void sema_enable_stats(bool enable) {
+	stats_enabled = enable;
+}
+
+bool sema_stats_enabled(void) {
+	return stats_enabled;
+}
+
+void sema_set_stats_scope(int scope) {
+	stats_scope = scope;
+}
+
+size_t sema_get_stats(int scope, struct SemaStats *out, size_t max) {
+	size_t n = 0;
+	pthread_mutex_lock(&registry_mutex);
+	for (struct StatsEntry *e = registry_head; e && n < max; e = e->next) {
+		if (e->scope == scope) {
+			out[n++] = e->stats;
+		}
 	}
+	pthread_mutex_unlock(&registry_mutex);
+	return n;
+}
+
+void sema_enable_watch(bool enable) {
+	watch_enabled = enable;
+}
+
+void sema_set_watch_scope(int scope) {
+	watch_scope = scope;
 }
 
-void delay(void) {
-	usleep(200);
+void sema_flush_thread_stats(void) {
+	flush_thread_stats(stats_slots);
 }
 
-void increment(int *ptr) {
-	int val = *ptr;
-	delay();
-	*ptr = val + 1;
+void sema_set_thread_role(const char *name, int index) {
+	thread_role = name;
+	thread_role_index = index;
 }
 
-void decrement(int *ptr) {
-	int val = *ptr;
-	delay();
-	*ptr = val - 1;
+unsigned long sema_activity(int scope) {
+	assert(scope >= 0 && scope < SEMA_WATCH_SCOPES);
+	return atomic_load_explicit(&scope_activity[scope], memory_order_relaxed);
+}
+
+size_t sema_blocked(int scope, struct SemaBlocked *out, size_t max) {
+	size_t n = 0;
+	pthread_mutex_lock(&blocked_mutex);
+	for (struct BlockedThread *b = blocked_head; b; b = b->next) {
+		Semaphore s = b->sem;
+		if (s->watch->scope != scope) {
+			continue;
+		}
+		if (n < max) {
+			out[n] = (struct SemaBlocked){
+				.role = b->role,
+				.index = b->index,
+				.name = s->watch->name,
+				.value = s->fd == -1 ? atomic_load(&s->value) : -1
+			};
+		}
+		n++;
+	}
+	pthread_mutex_unlock(&blocked_mutex);
+	return n;
+}
+
+void sema_abort_scope(int scope) {
+	assert(scope >= 0 && scope < SEMA_WATCH_SCOPES);
+	atomic_fetch_add(&scope_epochs[scope], 1);
+	// A futex waiter that checked the epoch just before the increment can
+	// still go to sleep after this wakes it, so the caller has to try again
+	// later if threads remain blocked. Eventfd waiters are woken through their
+	// abort eventfd, which stays readable until they leave the blocked list,
+	// so they leave the semaphore's value alone and cannot miss the wakeup.
+	pthread_mutex_lock(&blocked_mutex);
+	for (struct BlockedThread *b = blocked_head; b; b = b->next) {
+		if (b->sem->watch->scope == scope) {
+			if (b->word) {
+				futex_wake(b->word, INT_MAX);
+			} else {
+				efd_give(b->wake_fd, 1);
+			}
+		}
+	}
+	pthread_mutex_unlock(&blocked_mutex);
 }
@@ -3,36 +3,262 @@
 #ifndef SEMAPHORE_H
 #define SEMAPHORE_H
 
-#include <dispatch/dispatch.h>
+#include "util.h"
 
 #include <pthread.h>
+#include <stdalign.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stddef.h>
 
-// Use Apple's Grand Central Dispatch semaphore type.
-typedef dispatch_semaphore_t Semaphore;
+// Accumulated statistics for one semaphore, defined in semaphore.c.
+struct StatsBlock;
+
+// A thread blocked on a FIFO semaphore, defined in semaphore.c.
+struct FifoWaiter;
+
+// What the deadlock watchdog knows about a semaphore, defined in semaphore.c.
+struct WatchInfo;
+
+// Counting semaphore built on an atomic counter and futex parking. Waiting and
+// signaling only enter the kernel when a thread actually needs to block or be
+// woken up; the uncontended path stays entirely in user space. With the eventfd
+// backend, the permits live in the kernel instead and 'value' is unused. FIFO
+// semaphores guard 'value' and a queue of waiters with 'lock' instead.
+struct Semaphore {
+	int fd;                   // eventfd holding the permits, or -1 for futex
+	atomic_int value;         // number of available permits (never negative)
+	atomic_int waiters;       // number of threads blocked or about to block
+	atomic_int bulk_waiters;  // how many of those need more than one permit
+	atomic_int spin;          // moving average of spins that paid off, times 8
+	atomic_int lock;          // futex lock for FIFO semaphores
+	atomic_bool timed_out;    // a 'sema_wait' exceeded the wait limit
+	bool fifo;                // hand permits to waiters in arrival order
+	bool in_arena;            // allocated from an arena by 'sema_create'
+	bool info_in_arena;       // 'stats' and 'watch' are from an arena
+	struct StatsBlock *stats; // statistics, or null if not collecting them
+	struct FifoWaiter *head;  // oldest waiter of a FIFO semaphore
+	struct FifoWaiter *tail;  // newest waiter of a FIFO semaphore
+	struct WatchInfo *watch;  // watchdog information, or null if not watched
+};
+
+// Implementations of semaphores. The futex backend is the fastest, but only the
+// eventfd backend can be waited on with 'poll' alongside other descriptors.
+enum SemaBackend {
+	SEMA_FUTEX,   // atomic counter with futex parking (the default)
+	SEMA_FIFO,    // like SEMA_FUTEX, but strictly first in, first out
+	SEMA_EVENTFD  // eventfd in semaphore mode (Linux only)
+};
+
+// Maximum number of semaphores 'sema_wait_any' can wait on.
+#define SEMA_WAIT_ANY_MAX 64
+
+// Outcome of a wait that can give up.
+enum SemaStatus {
+	SEMA_ACQUIRED,  // the semaphore was decremented
+	SEMA_TIMED_OUT  // the semaphore was left unchanged
+};
+
+// Contention statistics for all semaphores with the same name in one scope.
+struct SemaStats {
+	const char *name;            // name given to 'sema_create_named'
+	unsigned long count;         // number of semaphores folded together
+	unsigned long waits;         // calls to wait functions
+	unsigned long blocked_waits; // waits that had to block in the kernel
+	unsigned long signals;       // calls to signal functions
+	unsigned long wakeups;       // signals that found a thread to wake up
+	int peak_waiters;            // maximum number of threads blocked at once
+	long long blocked_ns;        // total time spent blocked, in nanoseconds
+};
+
+// Number of scopes that can be watched for deadlocks. Semaphores created in
+// other scopes are not watched.
+#define SEMA_WATCH_SCOPES 64
+
+// A thread blocked in a wait function of a watched semaphore.
+struct SemaBlocked {
+	const char *role;  // name given to 'sema_set_thread_role', or null
+	int index;         // index given to 'sema_set_thread_role'
+	const char *name;  // name of the semaphore
+	int value;         // value of the semaphore, or -1 for eventfds
+};
+
+// Counts of contended waits, meaning calls to 'sema_wait' that could not take a
+// permit immediately.
+struct SpinCounts {
+	unsigned long spun;    // got a permit while spinning
+	unsigned long parked;  // had to block in the kernel
+};
+
+// Semaphores are passed around by pointer. A null pointer is a dummy semaphore.
+typedef struct Semaphore *Semaphore;
+
+// A semaphore on a cache line of its own. Semaphores next to each other in
+// memory would otherwise bounce the line between the cores using them.
+struct PaddedSemaphore {
+	alignas(CACHE_LINE_SIZE) struct Semaphore sem;
+};
+
+// A fixed-length array of semaphores stored inline, one per cache line.
+struct SemaArray {
+	struct PaddedSemaphore *items;  // null for an array of dummy semaphores
+	size_t len;
+	bool in_arena;                  // 'items' was allocated from an arena
+};
+
+// Sets the backend for semaphores created afterwards. Returns false if it is
+// not available on this platform.
+bool sema_set_backend(enum SemaBackend backend);
+
+// Returns the backend set by 'sema_set_backend'.
+enum SemaBackend sema_get_backend(void);
 
 // Creates a semaphore with an initial value. If 'real_semaphore' is false, then
 // it just returns a dummy semaphore, and 'signal' and 'wait' will do nothing.
 Semaphore sema_create(long value, bool real_semaphore);
 
-// Destroys the semaphore.
+// Like 'sema_create', but also gives the semaphore a name for statistics. The
+// name must outlive the semaphore (normally it is a string literal).
+Semaphore sema_create_named(const char *name, long value, bool real_semaphore);
+
+// Like 'sema_create_named', but the semaphore is strictly fair regardless of
+// the backend: threads queue up in 'sema_wait', and 'sema_signal' hands the
+// permit directly to the oldest one, so a new arrival can never take it first.
+// This costs a lock on every operation and a context switch on every handoff.
+Semaphore sema_create_fifo(const char *name, long value, bool real_semaphore);
+
+// Destroys the semaphore. Unlike Dispatch semaphores, it is fine to do this
+// when the value is lower than the initial value, as long as no threads are
+// still blocked on it.
 void sema_destroy(Semaphore s);
 
+// Initializes a semaphore stored inline (rather than created with
+// 'sema_create'). The name is used for statistics and may be null.
+void sema_init(struct Semaphore *s, const char *name, long value);
+
+// Finalizes a semaphore initialized with 'sema_init', without freeing it.
+void sema_fini(struct Semaphore *s);
+
+// Initializes an array of 'len' semaphores, all with the same name and initial
+// value. If 'real_semaphores' is false, they are all dummy semaphores.
+void sema_array_init(struct SemaArray *a, const char *name, size_t len,
+		long value, bool real_semaphores);
+
+// Finalizes all the semaphores in the array and frees it.
+void sema_array_destroy(struct SemaArray *a);
+
+// Returns the semaphore at index 'i' of the array.
+static inline Semaphore sema_at(const struct SemaArray *a, size_t i) {
+	return a->items ? &a->items[i].sem : NULL;
+}
+
 // Increments the semaphore, possibly waking up a thread.
 void sema_signal(Semaphore s);
 
-// Decrements the semaphore, and blocks if it becomes negative.
+// Decrements the semaphore, and blocks if it becomes negative. If spinning is
+// enabled (and the semaphore is not FIFO), it first spins for a while, adapting
+// how long to each semaphore. If a wait limit is set, it returns early when it
+// is exceeded.
 void sema_wait(Semaphore s);
 
-// Sleeps for a short time. Used to expose concurrency issues and cause
-// failures when semaphores are disabled.
-void delay(void);
+// Increments the semaphore by 'n' in one atomic step, waking up to 'n' threads
+// with a single system call.
+void sema_signal_n(Semaphore s, int n);
+
+// Decrements the semaphore by 'n' in one atomic step, blocking until at least
+// 'n' permits are available. It never takes only some of them, except with the
+// eventfd backend, which takes permits one at a time.
+void sema_wait_n(Semaphore s, int n);
+
+// Waits on the 'n' semaphores in 'sems' and decrements the first one that
+// becomes available, returning its index. All of them must use the eventfd
+// backend (or be dummies, in which case one is returned right away). If the
+// wait limit is exceeded, marks them all as timed out and returns 0.
+size_t sema_wait_any(const Semaphore *sems, size_t n);
+
+// Returns the eventfd of a semaphore using the eventfd backend, which becomes
+// readable when the semaphore is positive, or -1 for other semaphores.
+int sema_fd(Semaphore s);
+
+// Decrements the semaphore if it can be done without blocking.
+enum SemaStatus sema_try_wait(Semaphore s);
+
+// Like 'sema_wait', but gives up after 'timeout_ns' nanoseconds.
+enum SemaStatus sema_wait_timeout(Semaphore s, long long timeout_ns);
+
+// Sets a limit on how long 'sema_wait' blocks, in nanoseconds. Zero (the
+// default) means no limit. When a wait exceeds the limit, it marks the
+// semaphore as timed out and returns anyway, as if it were a dummy semaphore.
+// It also aborts the semaphore's watch scope (see 'sema_abort_scope'), so the
+// other waits of the iteration give up at once instead of each running into
+// the limit. That way a deadlocked problem still runs to completion quickly,
+// and the timeout can be detected when the semaphore is destroyed. A nonzero
+// limit enables watching (see 'sema_enable_watch') for semaphores created
+// afterwards, so that they have a scope to abort.
+void sema_set_wait_limit(long long limit_ns);
+
+// Returns true if any semaphore destroyed by the calling thread since the last
+// call to this function had a wait exceed the wait limit.
+bool sema_check_timeouts(void);
+
+// Sets the maximum number of iterations 'sema_wait' spins for before blocking.
+// Zero (the default) disables spinning. Should be called before any threads
+// start using semaphores.
+void sema_set_spin_limit(int limit);
+
+// Returns the maximum number of spin iterations set by 'sema_set_spin_limit'.
+int sema_get_spin_limit(void);
+
+// Returns the number of contended waits that spun and parked so far.
+struct SpinCounts sema_spin_counts(void);
+
+// Enables or disables collecting statistics for semaphores created afterwards.
+// Each thread counts operations privately, and the counts are folded into a
+// global registry when the thread exits, flushes, or destroys a semaphore.
+void sema_enable_stats(bool enable);
+
+// Returns true if statistics are enabled.
+bool sema_stats_enabled(void);
+
+// Folds the calling thread's statistics into the registry's blocks. Threads
+// that outlive the semaphores they used (such as pool threads) must call this
+// before those semaphores can be destroyed.
+void sema_flush_thread_stats(void);
+
+// Sets the scope (for example, a problem number) under which semaphores created
+// by the calling thread are recorded in the registry.
+void sema_set_stats_scope(int scope);
+
+// Copies up to 'max' registry entries for 'scope' into 'out', in the order the
+// names were first destroyed. Returns the number of entries copied.
+size_t sema_get_stats(int scope, struct SemaStats *out, size_t max);
+
+// Enables or disables watching semaphores created afterwards for deadlocks.
+// Watched semaphores count their operations per scope and register threads
+// while they are blocked.
+void sema_enable_watch(bool enable);
+
+// Sets the scope (for example, a job running one problem at a time) under which
+// semaphores created by the calling thread are watched. It is separate from the
+// statistics scope so that jobs sharing a problem are watched independently.
+void sema_set_watch_scope(int scope);
+
+// Names the calling thread in the reports from 'sema_blocked'. The name must
+// outlive the thread's waits (normally it is a string literal).
+void sema_set_thread_role(const char *name, int index);
+
+// Returns the number of signals and waits on watched semaphores in 'scope' so
+// far. The watchdog considers a scope stuck when this stops changing.
+unsigned long sema_activity(int scope);
 
-// Increments the given integer, with a delay between reading and writing.
-void increment(int *ptr);
+// Copies up to 'max' entries describing the threads currently blocked on
+// watched semaphores in 'scope' into 'out'. Returns the number of threads
+// blocked, which may be more than 'max'.
+size_t sema_blocked(int scope, struct SemaBlocked *out, size_t max);
 
-// Decrements the given integer, with a delay between reading and writing.
-void decrement(int *ptr);
+// Aborts all watched semaphores created so far in 'scope': blocked threads wake
+// up, and those semaphores act from then on as if every wait that would block
+// exceeded the wait limit. Semaphores created afterwards are not affected.
+void sema_abort_scope(int scope);
 
 #endif
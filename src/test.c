@@ -2,16 +2,29 @@
 
 #include "test.h"
 
+#include "arena.h"
+#include "buffer.h"
+#include "estimate.h"
+#include "metrics.h"
+#include "pool.h"
 #include "problems.h"
+#include "semaphore.h"
+#include "topology.h"
 #include "util.h"
+#include "watchdog.h"
 
 #include <assert.h>
 #include <errno.h>
+#include <limits.h>
+#include <poll.h>
 #include <pthread.h>
+#include <signal.h>
 #include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
 // There is a postive test and negative test for each problem.
@@ -26,15 +39,22 @@
 // Width of the ASCII progress bar, in characters.
 #define PROGRESS_BAR_WIDTH 32
 
-// Converts a zero-based index to a one-based problem number.
+// Maximum number of distinct semaphore names reported for one problem.
+#define MAX_STATS_PER_PROBLEM 16
+
+// Converts a zero-based index to a one-based problem number, and vice versa.
 #define INDEX_TO_PROBLEM(i) ((int)((i) + 1))
+#define PROBLEM_TO_INDEX(p) ((size_t)((p) - 1))
 
-// There are four possible states for a test.
-#define N_STATES 4
+// There are six possible states for a test. CRASH is only reached with
+// isolated workers, when one dies while running a chunk of the test.
+#define N_STATES 6
 enum State {
 	PENDING,
 	PASS,
 	FAIL,
+	TIMEOUT,
+	CRASH,
 	SKIP
 };
 
@@ -44,20 +64,115 @@ struct Result {
 	enum State neg_state : 4;  // state of test with semaphores disabled
 };
 
-// A Task specifies a range of exercise problems to test. Performing a Task
-// consists of executing the solution programs for the problems beginning at
-// 'start' (zero-based, not one-based), and storing the results in 'results',
-// filling from 'results[start]' to 'results[end-1]'. The 'test_count' variable
-// should be incremented after every positive test and every negative test.
-struct Task {
-	unsigned short start;       // start index in 'result' (zero-based)
-	unsigned short end;         // end index in 'result' (exclusive)
-	unsigned short pos_iters;   // iterations for the positive case
-	unsigned short neg_iters;   // iterations for the negative case
-	struct Result *results;     // array of all results
-	atomic_ushort *test_count;  // pointer to test counter
+// Number of iterations of a test that the parallel scheduler runs as one chunk.
+// Tests with more than CHUNK_ITERS * MAX_TEST_CHUNKS iterations use bigger
+// chunks, so that the number of chunks stays bounded.
+#define CHUNK_ITERS 10
+#define MAX_TEST_CHUNKS 4096
+
+// Number of iterations of a problem that a soak worker runs at a time.
+#define SOAK_CHUNK_ITERS 10
+
+// Bounds on the time between progress lines in soak mode, in seconds.
+#define MIN_SOAK_REPORT_S 1
+#define MAX_SOAK_REPORT_S 60
+
+// Number of log events the deadlock watchdog prints for a stalled problem.
+#define WATCHDOG_EVENTS 16
+
+// A Test is the positive or negative test of one problem, being run in parallel
+// as chunks of iterations. Its state starts out as the result it has if every
+// chunk runs to completion (PASS for positive tests, FAIL for negative tests),
+// and the first chunk to reach a different conclusion sets it, which cancels
+// the chunks that have not finished.
+struct Test {
+	int problem;
+	bool positive;
+	atomic_int state;    // result of the test, as an 'enum State'
+	atomic_int pending;  // number of chunks not yet finished
+};
+
+// A Chunk is a unit of work for the parallel scheduler: 'iters' iterations of
+// the test 'test', starting from iteration 'first'.
+struct Chunk {
+	struct Test *test;
+	long long first;  // index of the first iteration in the test
+	long long iters;
+};
+
+// A Deque holds the chunks dealt to one worker. The worker takes chunks from
+// the front, and other workers that run out steal from the back.
+struct Deque {
+	pthread_mutex_t mutex;
+	struct Chunk *chunks;
+	size_t front;
+	size_t back;
 };
 
+// Shared state for the workers in 'run_parallel'. The 'test_count' variable is
+// incremented when all chunks of a positive or negative test have finished.
+struct Scheduler {
+	size_t n_workers;
+	struct Deque *deques;           // one deque per worker
+	struct Result *results;         // array of all results
+	pthread_mutex_t results_mutex;  // serializes writes to 'results'
+	atomic_ullong test_count;       // number of finished tests
+};
+
+// Argument for a worker thread in 'run_parallel'.
+struct Worker {
+	struct Scheduler *sched;
+	size_t index;
+};
+
+// Allocations made while testing one problem, over all positive and negative
+// iterations: those served by an arena, and those that went to the heap.
+struct ProblemAllocs {
+	atomic_ulong arena;
+	atomic_ulong heap;
+	atomic_ullong iterations;
+};
+
+// Index of the job running on this thread, which is its scope for the deadlock
+// watchdog. It is 0 except on worker threads of parallel and soak runs.
+static _Thread_local int job_index = 0;
+
+// Allocation totals for each problem, indexed by 'PROBLEM_TO_INDEX'.
+static struct ProblemAllocs problem_allocs[N_PROBLEMS];
+
+// Number of iterations for the negative test of each problem, indexed by
+// 'PROBLEM_TO_INDEX'. They are all 'params->neg_iters', except that estimates
+// loaded from 'params->estimates' lower them for problems that fail reliably.
+static long long neg_iters_for[N_PROBLEMS];
+
+// Timing of a positive or negative test, over all of its iterations. When the
+// iterations are split into chunks, the wall time runs from the start of the
+// first chunk to the end of the last one.
+struct Timing {
+	long long start_ns;        // when the first chunk started, or 0
+	long long end_ns;          // when the last chunk finished
+	long long cpu_ns;          // CPU time used by the test and its threads
+	long long failed_at;       // first failing iteration (one-based), or 0
+	struct Histogram latency;  // duration of each iteration
+};
+
+// Timing figures for a test, in the units they are reported in.
+struct TimingReport {
+	unsigned long long iterations;  // number of iterations run
+	long long first_failure;        // zero-based index, or -1 if none
+	double wall_s;             // wall time in seconds
+	double cpu_s;              // CPU time in seconds
+	double iters_per_s;        // throughput
+	double p50_us;             // median iteration latency
+	double p99_us;             // 99th percentile iteration latency
+	double max_us;             // maximum iteration latency
+};
+
+// Timings for each problem, indexed by 'PROBLEM_TO_INDEX' and then 0 for the
+// positive test and 1 for the negative test.
+static struct Timing timings[N_PROBLEMS][2];
+static pthread_mutex_t timings_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 // A string of dots used for padding.
 static const char *const padding_dots = "......................";
 
@@ -74,14 +189,25 @@ static const char* state_str(enum State state) {
 		return " ok ";
 	case FAIL:
 		return "FAIL";
+	case TIMEOUT:
+		return "TIME";
+	case CRASH:
+		return "CRSH";
 	case SKIP:
 		return "skip";
 	}
+	assert(false);
+	return "????";
+}
+
+// Returns true if the state is bad (meaning we must exit with a failure).
+static bool state_bad(enum State state) {
+	return state == FAIL || state == TIMEOUT || state == CRASH;
 }
 
 // Returns true if the result is good (meaning we can exit with exit status 0).
 static bool result_good(struct Result result) {
-	return result.pos_state != FAIL && result.neg_state != FAIL;
+	return !state_bad(result.pos_state) && !state_bad(result.neg_state);
 }
 
 // Returns true if all results are good in the array of size N_PROBLEMS.
@@ -94,19 +220,88 @@ static bool all_results_good(struct Result *results) {
 	return true;
 }
 
-// Prints the test result for the given problem on one line.
+// Returns a copy of the timing for the positive or negative test of a problem.
+static struct Timing get_timing(int problem, bool positive) {
+	pthread_mutex_lock(&timings_mutex);
+	struct Timing t = timings[PROBLEM_TO_INDEX(problem)][positive ? 0 : 1];
+	pthread_mutex_unlock(&timings_mutex);
+	return t;
+}
+
+// Converts a timing into the figures that are reported.
+static struct TimingReport report_timing(const struct Timing *t) {
+	const struct Histogram *h = &t->latency;
+	double wall_s = (t->end_ns - t->start_ns) / 1e9;
+	return (struct TimingReport){
+		.iterations = h->count,
+		.first_failure = t->failed_at - 1,
+		.wall_s = wall_s,
+		.cpu_s = t->cpu_ns / 1e9,
+		.iters_per_s = wall_s > 0 ? h->count / wall_s : 0.0,
+		.p50_us = hist_percentile(h, 0.5) / 1e3,
+		.p99_us = hist_percentile(h, 0.99) / 1e3,
+		.max_us = h->max_ns / 1e3
+	};
+}
+
+// Returns a lowercase name for the given state, for machine-readable output.
+static const char *state_name(enum State state) {
+	switch (state) {
+	case PENDING:
+		return "pending";
+	case PASS:
+		return "pass";
+	case FAIL:
+		return "fail";
+	case TIMEOUT:
+		return "timeout";
+	case CRASH:
+		return "crash";
+	case SKIP:
+		return "skip";
+	}
+	return "unknown";
+}
+
+// Prints the timing columns for a test: wall time and CPU time in seconds,
+// iterations per second, and the median, 99th percentile, and maximum
+// iteration latency in microseconds.
+static void print_timing(const struct Timing *t) {
+	if (t->latency.count == 0) {
+		printf("      -      -      -      -      -      -");
+		return;
+	}
+	struct TimingReport r = report_timing(t);
+	printf(" %6.2lf %6.2lf %6.0lf %6.0lf %6.0lf %6.0lf", r.wall_s, r.cpu_s,
+			r.iters_per_s, r.p50_us, r.p99_us, r.max_us);
+}
+
+// Prints the test result for the given problem on one line, followed by the
+// timing of its positive and negative tests.
 static void print_result(int problem, struct Result result) {
 	const char *name = get_problem_name(problem);
 	const char *pad = padding_dots + strlen(name);
 	const char *pos_msg = state_str(result.pos_state);
 	const char *neg_msg = state_str(result.neg_state);
-	printf("%02d. %s %s %s %s\n", problem, name, pad, pos_msg, neg_msg);
+	struct Timing pos = get_timing(problem, true);
+	struct Timing neg = get_timing(problem, false);
+	printf("%02d. %s %s %s %s ", problem, name, pad, pos_msg, neg_msg);
+	print_timing(&pos);
+	printf(" ");
+	print_timing(&neg);
+	printf("\n");
 }
 
 // Prints a header for the test results.
 static void print_header(void) {
-	printf("No. Problem name            Pos. Neg.\n");
-	printf("=== ======================= ==== ====\n");
+	printf("%38s%-43s%s\n", "", "Positive test timing",
+			"Negative test timing");
+	printf("No. Problem name            Pos. Neg."
+			"  Wall s  CPU s   It/s p50 us p99 us max us"
+			"  Wall s  CPU s   It/s p50 us p99 us max us\n");
+	printf("=== ======================= ==== ===="
+			"  ====== ====== ====== ====== ====== ======"
+			"  ====== ====== ====== ====== ====== ======\n");
 }
 
 // Prints a summary of the test results.
@@ -116,8 +311,141 @@ static void print_summary(struct Result *results) {
 		counts[results[i].pos_state]++;
 		counts[results[i].neg_state]++;
 	}
-	printf("Summary: %d passed, %d failed, %d skipped.\n",
-			counts[PASS], counts[FAIL], counts[SKIP]);
+	printf("Summary: %d passed, %d failed, %d timed out, %d crashed, "
+			"%d skipped.\n", counts[PASS], counts[FAIL], counts[TIMEOUT],
+			counts[CRASH], counts[SKIP]);
+}
+
+// Prints how many contended semaphore waits were satisfied by spinning, and
+// how many had to block. Does nothing if spinning is disabled.
+static void print_spin_report(void) {
+	int limit = sema_get_spin_limit();
+	if (limit == 0) {
+		return;
+	}
+	struct SpinCounts counts = sema_spin_counts();
+	unsigned long total = counts.spun + counts.parked;
+	double percent = total == 0 ? 0.0 : 100.0 * counts.spun / total;
+	printf("Spinning: %lu of %lu contended waits spun (%.1lf%%), %lu parked "
+			"(limit %d).\n", counts.spun, total, percent, counts.parked, limit);
+}
+
+// Prints the semaphore statistics recorded for the given problem, if any.
+static void print_problem_stats(int problem) {
+	struct SemaStats stats[MAX_STATS_PER_PROBLEM];
+	size_t n = sema_get_stats(problem, stats, MAX_STATS_PER_PROBLEM);
+	if (n == 0) {
+		return;
+	}
+	printf("%02d. %s\n", problem, get_problem_name(problem));
+	for (size_t i = 0; i < n; i++) {
+		struct SemaStats *st = &stats[i];
+		printf("    %-18s %5lu %9lu %9lu %9lu %9lu %4d %11.3lf\n",
+				st->name, st->count, st->waits, st->blocked_waits,
+				st->signals, st->wakeups, st->peak_waiters,
+				st->blocked_ns / 1e6);
+	}
+}
+
+// Prints the event timings recorded for the problems in the range ['first',
+// 'last'], if any.
+static void print_metrics_report(int first, int last) {
+	bool header = false;
+	for (int problem = first; problem <= last; problem++) {
+		struct Metric metrics[MAX_STATS_PER_PROBLEM];
+		size_t n = metric_get(problem, metrics, MAX_STATS_PER_PROBLEM);
+		if (n == 0) {
+			continue;
+		}
+		if (!header) {
+			printf("\nEvent timings (positive tests):\n");
+			printf("No. Event                  Count    Mean us     Max us\n");
+			printf("=== ================== ========= ========== ==========\n");
+			header = true;
+		}
+		printf("%02d. %s\n", problem, get_problem_name(problem));
+		for (size_t i = 0; i < n; i++) {
+			struct Metric *m = &metrics[i];
+			printf("    %-18s %9lu %10.3lf %10.3lf\n", m->name, m->count,
+					m->total_ns / 1e3 / m->count, m->max_ns / 1e3);
+		}
+	}
+}
+
+// Number of rounds timed by 'alloc_cost_ns', and allocations in each round.
+#define ALLOC_COST_ROUNDS 4096
+#define ALLOC_COST_BATCH 32
+
+// Returns the average nanoseconds spent per allocation in rounds that allocate
+// a batch of blocks of mixed sizes and then free them all, like an iteration
+// does. The memory comes from the heap if 'arena' is false, or else from an
+// arena that is reset after each round.
+static double alloc_cost_ns(bool arena) {
+	if (arena) {
+		arena_begin();
+	}
+	void *blocks[ALLOC_COST_BATCH];
+	bool in_arena[ALLOC_COST_BATCH];
+	long long start = monotonic_ns();
+	for (int round = 0; round < ALLOC_COST_ROUNDS; round++) {
+		for (int i = 0; i < ALLOC_COST_BATCH; i++) {
+			size_t size = (size_t)64 << (i % 6);
+			blocks[i] = arena_alloc(size, &in_arena[i]);
+			*(volatile char *)blocks[i] = 0;
+		}
+		for (int i = 0; i < ALLOC_COST_BATCH; i++) {
+			arena_free(blocks[i], in_arena[i]);
+		}
+		if (arena) {
+			arena_reset();
+		}
+	}
+	long long ns = monotonic_ns() - start;
+	if (arena) {
+		arena_end();
+	}
+	return (double)ns / (ALLOC_COST_ROUNDS * ALLOC_COST_BATCH);
+}
+
+// Prints how many allocations per iteration the problems in the range ['first',
+// 'last'] made from the heap and from their arenas, if any, and estimates the
+// time per iteration that the arena saved compared to using the heap for all.
+static void print_alloc_report(int first, int last) {
+	double saved_ns = alloc_cost_ns(false) - alloc_cost_ns(true);
+	printf("\nAllocations per iteration (all tests; an arena allocation saves"
+			" about %.0lf ns):\n", saved_ns);
+	printf("No. Problem                 Iterations       Heap      Arena"
+			"   Saved us\n");
+	printf("=== ==================== ============ ========== =========="
+			" ==========\n");
+	for (int problem = first; problem <= last; problem++) {
+		struct ProblemAllocs *a = &problem_allocs[PROBLEM_TO_INDEX(problem)];
+		unsigned long long iters = atomic_load(&a->iterations);
+		if (iters == 0) {
+			continue;
+		}
+		double arena = (double)atomic_load(&a->arena) / iters;
+		printf("%02d. %-20.20s %12llu %10.2lf %10.2lf %10.3lf\n", problem,
+				get_problem_name(problem), iters,
+				(double)atomic_load(&a->heap) / iters, arena,
+				arena * saved_ns / 1e3);
+	}
+}
+
+// Prints semaphore contention statistics for the problems in the range
+// ['first', 'last']. Does nothing if statistics are disabled.
+static void print_stats_report(int first, int last) {
+	if (!sema_stats_enabled()) {
+		return;
+	}
+	printf("\nSemaphore statistics (positive tests):\n");
+	printf("No. Semaphore           Sems     Waits   Blocked   Signals"
+			"     Woken Peak  Blocked ms\n");
+	printf("=== ================== ===== ========= ========= ========="
+			" ========= ==== ===========\n");
+	for (int problem = first; problem <= last; problem++) {
+		print_problem_stats(problem);
+	}
 }
 
 // Prints all results from 'results', an array of length N_PROBLEMS, with a
@@ -149,46 +477,139 @@ static void update_progress(struct Result *results, size_t completed) {
 	print_progress_bar(completed);
 }
 
-// Tests the given problem function 'iters' times using the positive case
-// (success expected with semaphores enabled). Returns the resulting state.
-static enum State test_positive(ProblemFn function, int iters) {
+// Starts running iterations of a problem on the calling thread, which gets an
+// arena so that each iteration reuses the memory of the one before.
+static void begin_iterations(void) {
+	arena_begin();
+}
+
+// Finishes running 'iterations' iterations of 'problem' on the calling thread,
+// adding them and the allocations made from its arena to the problem's totals.
+static void end_iterations(int problem, long long iterations) {
+	struct AllocCounts counts = arena_counts();
+	arena_end();
+	struct ProblemAllocs *a = &problem_allocs[PROBLEM_TO_INDEX(problem)];
+	atomic_fetch_add(&a->arena, counts.arena);
+	atomic_fetch_add(&a->heap, counts.heap);
+	atomic_fetch_add(&a->iterations, (unsigned long long)iterations);
+}
+
+// Adds the timing 'src' of some iterations of a test to 'dst'.
+static void merge_timing(struct Timing *dst, const struct Timing *src) {
+	if (src->failed_at != 0
+			&& (dst->failed_at == 0 || src->failed_at < dst->failed_at)) {
+		dst->failed_at = src->failed_at;
+	}
+	if (dst->start_ns == 0 || src->start_ns < dst->start_ns) {
+		dst->start_ns = src->start_ns;
+	}
+	dst->end_ns = MAX(dst->end_ns, src->end_ns);
+	dst->cpu_ns += src->cpu_ns;
+	hist_merge(&dst->latency, &src->latency);
+}
+
+// Adds the timing of some iterations of a test to the totals for the test.
+static void add_timing(int problem, bool positive, const struct Timing *t) {
+	pthread_mutex_lock(&timings_mutex);
+	merge_timing(&timings[PROBLEM_TO_INDEX(problem)][positive ? 0 : 1], t);
+	pthread_mutex_unlock(&timings_mutex);
+}
+
+// Runs up to 'iters' iterations of the given problem, numbered from 'first',
+// with semaphores enabled if 'positive' is true, and stores their timing in
+// 'timing'. Returns PASS if the iterations behave as expected (all of them
+// succeed for the positive case, or one fails for the negative case), and FAIL
+// otherwise. If a semaphore wait exceeds the wait limit, the result is TIMEOUT
+// regardless. Stops early once the result is known, or if 'test' is not NULL
+// and another chunk has already decided it.
+static enum State run_batch(int problem, bool positive, long long first,
+		long long iters, struct Test *test, struct Timing *timing) {
+	const enum State expected = positive ? PASS : FAIL;
+	ProblemFn function = get_problem_function(problem);
+	if (positive) {
+		sema_set_stats_scope(problem);
+		metric_set_scope(problem);
+	}
+	watchdog_set_job(job_index, problem);
+	sema_check_timeouts();
+	begin_iterations();
+	hist_init(&timing->latency);
+	timing->start_ns = monotonic_ns();
+	const long long start_cpu_ns = thread_cpu_ns() + pool_cpu_ns();
+	enum State state = expected;
+	long long done = 0;
+	while (done < iters) {
+		if (test && atomic_load(&test->state) != (int)expected) {
+			break;
+		}
+		long long iter_start_ns = monotonic_ns();
+		bool success = function(positive);
+		hist_record(&timing->latency, monotonic_ns() - iter_start_ns);
+		arena_reset();
+		done++;
+		if (sema_check_timeouts()) {
+			state = TIMEOUT;
+			break;
+		}
+		if (!success) {
+			state = positive ? FAIL : PASS;
+			break;
+		}
+	}
+	end_iterations(problem, done);
+	timing->end_ns = monotonic_ns();
+	timing->cpu_ns = thread_cpu_ns() + pool_cpu_ns() - start_cpu_ns;
+	timing->failed_at = state == expected ? 0 : first + done;
+	return state;
+}
+
+// Like 'run_batch', but adds the timing to the totals for the test.
+static enum State run_iterations(int problem, bool positive, long long first,
+		long long iters, struct Test *test) {
+	struct Timing timing;
+	enum State state =
+		run_batch(problem, positive, first, iters, test, &timing);
+	add_timing(problem, positive, &timing);
+	return state;
+}
+
+// Tests the given problem 'iters' times using the positive case (success
+// expected with semaphores enabled). Returns the resulting state. If a
+// semaphore wait exceeds the wait limit, the result is TIMEOUT regardless.
+static enum State test_positive(int problem, long long iters) {
 	if (iters == 0) {
 		return SKIP;
 	}
 	// In order to pass, every iteration must succeed.
-	for (int i = 0; i < iters; i++) {
-		if (!function(true)) {
-			return FAIL;
-		}
-	}
-	return PASS;
+	return run_iterations(problem, true, 0, iters, NULL);
 }
 
-// Tests the given problem function 'iters' times using the negative case
-// (failure expected with semaphores disabled). Returns the resulting state.
-static enum State test_negative(ProblemFn function, int iters) {
+// Tests the given problem 'iters' times using the negative case (failure
+// expected with semaphores disabled). Returns the resulting state.
+static enum State test_negative(int problem, long long iters) {
 	if (iters == 0) {
 		return SKIP;
 	}
 	// In order to pass, at least one iteration must not succeed.
-	for (int i = 0; i < iters; i++) {
-		if (!function(false)) {
-			return PASS;
-		}
-	}
-	return FAIL;
+	return run_iterations(problem, false, 0, iters, NULL);
 }
 
 // Tests the given exercise problem, with 'pos_iters' iterations for the
 // positive case and 'neg_iters' iterations for the negative case.
-static struct Result test_problem(int problem, int pos_iters, int neg_iters) {
-	ProblemFn function = get_problem_function(problem);
+static struct Result test_problem(
+		int problem, long long pos_iters, long long neg_iters) {
 	return (struct Result){
-		.pos_state = test_positive(function, pos_iters),
-		.neg_state = test_negative(function, neg_iters)
+		.pos_state = test_positive(problem, pos_iters),
+		.neg_state = test_negative(problem, neg_iters)
 	};
 }
 
+// Returns true if the human-readable results should be printed. They are left
+// out when machine-readable output goes to stdout instead.
+static bool shows_table(const struct Parameters *params) {
+	return params->format == FORMAT_TABLE || params->output != NULL;
+}
+
 // Runs the tests specified by 'params' sequentially, storing results in the
 // 'results' array and printing them as tests complete. Clears the screen and
 // updates results periodically if 'params->interactive' is true.
@@ -197,125 +618,1197 @@ static void run_sequential(
 	assert(params->problem == ALL_PROBLEMS);
 	assert(params->jobs == 1);
 
-	const int pos_iters = params->pos_iters;
-	const int neg_iters = params->neg_iters;
+	const long long pos_iters = params->pos_iters;
 	if (params->interactive) {
 		update_progress(results, 0);
 		for (size_t i = 0; i < N_PROBLEMS; i++) {
-			ProblemFn function = get_problem_function(INDEX_TO_PROBLEM(i));
-			results[i].pos_state = test_positive(function, pos_iters);
+			int problem = INDEX_TO_PROBLEM(i);
+			results[i].pos_state = test_positive(problem, pos_iters);
 			update_progress(results, i * 2 + 1);
-			results[i].neg_state = test_negative(function, neg_iters);
+			results[i].neg_state = test_negative(problem, neg_iters_for[i]);
 			update_progress(results, i * 2 + 2);
 		}
-	} else {
+	} else if (shows_table(params)) {
 		print_header();
 		for (size_t i = 0; i < N_PROBLEMS; i++) {
 			int problem = INDEX_TO_PROBLEM(i);
-			results[i] = test_problem(problem, pos_iters, neg_iters);
+			results[i] = test_problem(problem, pos_iters, neg_iters_for[i]);
 			print_result(problem, results[i]);
 		}
 		print_summary(results);
+	} else {
+		for (size_t i = 0; i < N_PROBLEMS; i++) {
+			int problem = INDEX_TO_PROBLEM(i);
+			results[i] = test_problem(problem, pos_iters, neg_iters_for[i]);
+		}
 	}
 }
 
-// Performs the Task 'arg'. Always returns NULL.
-static void *perform_task(void *arg) {
-	struct Task *task = (struct Task *)arg;
-	for (unsigned short i = task->start; i < task->end; i++) {
-		ProblemFn function = get_problem_function(INDEX_TO_PROBLEM(i));
-		task->results[i].pos_state = test_positive(function, task->pos_iters);
-		++*task->test_count;
-		task->results[i].neg_state = test_negative(function, task->neg_iters);
-		++*task->test_count;
+// Pins the worker thread 'thread' to a CPU according to the placement in
+// 'params', if there is one. Worker 'index' gets the CPU at that index in
+// 'params->cpus', wrapping around.
+static void pin_worker(const struct Parameters *params, pthread_t thread,
+		size_t index) {
+	if (params->n_cpus > 0) {
+		pin_thread(thread, &params->cpus[index % (size_t)params->n_cpus], 1);
+	}
+}
 
+// Stores the result of a finished test in 'sched->results'.
+static void finish_test(struct Scheduler *sched, struct Test *test) {
+	enum State state = (enum State)atomic_load(&test->state);
+	struct Result *result = &sched->results[PROBLEM_TO_INDEX(test->problem)];
+	pthread_mutex_lock(&sched->results_mutex);
+	if (test->positive) {
+		result->pos_state = state;
+	} else {
+		result->neg_state = state;
+	}
+	pthread_mutex_unlock(&sched->results_mutex);
+	++sched->test_count;
+}
+
+// Runs the given chunk, and finishes its test if it was the last one.
+static void run_chunk(struct Scheduler *sched, struct Chunk chunk) {
+	struct Test *test = chunk.test;
+	int expected = test->positive ? PASS : FAIL;
+	enum State state = run_iterations(
+			test->problem, test->positive, chunk.first, chunk.iters, test);
+	if ((int)state != expected) {
+		atomic_compare_exchange_strong(&test->state, &expected, (int)state);
+	}
+	if (atomic_fetch_sub(&test->pending, 1) == 1) {
+		finish_test(sched, test);
+	}
+}
+
+// Takes the next chunk for worker 'self' and stores it in 'chunk', first from
+// its own deque and then by stealing from the others. Returns false if there
+// are no chunks left anywhere. Since no chunks are added once the workers
+// start, this means the worker is done.
+static bool next_chunk(
+		struct Scheduler *sched, size_t self, struct Chunk *chunk) {
+	for (size_t i = 0; i < sched->n_workers; i++) {
+		struct Deque *d = &sched->deques[(self + i) % sched->n_workers];
+		pthread_mutex_lock(&d->mutex);
+		bool found = d->front < d->back;
+		if (found) {
+			*chunk = i == 0 ? d->chunks[d->front++] : d->chunks[--d->back];
+		}
+		pthread_mutex_unlock(&d->mutex);
+		if (found) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// Runs chunks for the Worker 'arg' until there are none left. Always returns
+// NULL.
+static void *run_worker(void *arg) {
+	struct Worker *worker = (struct Worker *)arg;
+	job_index = (int)worker->index;
+	struct Chunk chunk;
+	while (next_chunk(worker->sched, worker->index, &chunk)) {
+		run_chunk(worker->sched, chunk);
 	}
 	return NULL;
 }
 
-// Runs the tests specified by 'params' in parallel, storing results in the
-// 'results' array. Clears the screen and updates results periodically while
-// jobs are progressing if 'params->interactive' is true. If there was an
+// Returns the number of iterations in each chunk of a test with 'iters'
+// iterations (except the last, which may be smaller).
+static long long chunk_iters(long long iters) {
+	return MAX(CHUNK_ITERS, (iters + MAX_TEST_CHUNKS - 1) / MAX_TEST_CHUNKS);
+}
+
+// Returns the number of chunks needed for 'iters' iterations.
+static size_t chunk_count(long long iters) {
+	long long size = chunk_iters(iters);
+	return (size_t)((iters + size - 1) / size);
+}
+
+// Returns the number of chunks in the tests of the 'n_problems' problems
+// starting at 'first', with 'pos_iters' positive iterations each.
+static size_t total_chunk_count(
+		int first, size_t n_problems, long long pos_iters) {
+	size_t total = 0;
+	for (size_t i = 0; i < n_problems; i++) {
+		int problem = first + (int)i;
+		total += chunk_count(pos_iters)
+			+ chunk_count(neg_iters_for[PROBLEM_TO_INDEX(problem)]);
+	}
+	return total;
+}
+
+// Returns chunk 'j' of the test 'test', which has 'iters' iterations.
+static struct Chunk make_chunk(struct Test *test, long long iters, size_t j) {
+	long long size = chunk_iters(iters);
+	long long first = (long long)j * size;
+	return (struct Chunk){
+		.test = test,
+		.first = first,
+		.iters = MIN(size, iters - first)
+	};
+}
+
+// Sets up 'tests' (a positive and a negative test for each of the 'n_tests / 2'
+// problems starting at 'first') and deals their chunks round-robin into the
+// deques of 'sched'. Tests with no iterations are finished right away as
+// skipped.
+static void deal_chunks(struct Scheduler *sched, struct Test *tests,
+		size_t n_tests, int first, long long pos_iters) {
+	size_t next = 0;
+	for (size_t i = 0; i < n_tests; i++) {
+		struct Test *test = &tests[i];
+		test->problem = first + (int)(i / 2);
+		test->positive = i % 2 == 0;
+		long long iters = test->positive ? pos_iters
+			: neg_iters_for[PROBLEM_TO_INDEX(test->problem)];
+		size_t n_chunks = chunk_count(iters);
+		atomic_init(&test->state, test->positive ? PASS : FAIL);
+		atomic_init(&test->pending, (int)n_chunks);
+		if (n_chunks == 0) {
+			atomic_store(&test->state, SKIP);
+			finish_test(sched, test);
+			continue;
+		}
+		for (size_t j = 0; j < n_chunks; j++) {
+			struct Deque *d = &sched->deques[next++ % sched->n_workers];
+			d->chunks[d->back++] = make_chunk(test, iters, j);
+		}
+	}
+}
+
+// Runs the tests specified by 'params' in parallel (for all problems, or just
+// one), storing results in the 'results' array. Each test is split into chunks
+// of at least CHUNK_ITERS iterations, which are dealt to per-worker deques.
+// Workers that run out of chunks steal from the others, so one slow problem
+// does not hold up the rest. Clears the screen and updates results periodically
+// while jobs are progressing if 'params->interactive' is true. If there was an
 // pthread error, prints an error message and returns false.
 static bool run_parallel(
 		const struct Parameters *params, struct Result *results) {
-	assert(params->problem == ALL_PROBLEMS);
 	assert(params->jobs > 1);
 
-	const size_t jobs = (size_t)MIN(params->jobs, N_PROBLEMS);
-	const unsigned short length = N_PROBLEMS / jobs;
-	pthread_t threads[jobs];
-	struct Task tasks[jobs];
-	atomic_ushort test_count = 0;
-
-	struct Task base_task = {
-		.start = 0,
-		.end = 0,
-		.pos_iters = (unsigned short)params->pos_iters,
-		.neg_iters = (unsigned short)params->neg_iters,
+	const bool all = params->problem == ALL_PROBLEMS;
+	const int first = all ? 1 : params->problem;
+	const size_t n_problems = all ? N_PROBLEMS : 1;
+	const size_t n_tests = n_problems * 2;
+	const size_t total_chunks =
+		total_chunk_count(first, n_problems, params->pos_iters);
+	const size_t jobs = MAX(1, MIN((size_t)params->jobs, total_chunks));
+	const size_t max_chunks = (total_chunks + jobs - 1) / jobs;
+
+	struct Scheduler sched = {
+		.n_workers = jobs,
+		.deques = malloc(jobs * sizeof *sched.deques),
 		.results = results,
-		.test_count = &test_count
+		.results_mutex = PTHREAD_MUTEX_INITIALIZER,
+		.test_count = 0
 	};
-
-	// Create threads for the tasks.
 	for (size_t i = 0; i < jobs; i++) {
-		tasks[i] = base_task;
-		tasks[i].start = length * (unsigned short)i;
-		tasks[i].end = i == jobs - 1 ? N_PROBLEMS : tasks[i].start + length;
-		int err = pthread_create(&threads[i], NULL, perform_task, &tasks[i]);
+		struct Deque *d = &sched.deques[i];
+		pthread_mutex_init(&d->mutex, NULL);
+		d->chunks = malloc(MAX(1, max_chunks) * sizeof *d->chunks);
+		d->front = 0;
+		d->back = 0;
+	}
+	struct Test tests[n_tests];
+	deal_chunks(&sched, tests, n_tests, first, params->pos_iters);
+
+	// Create a thread for each worker.
+	bool ok = true;
+	pthread_t threads[jobs];
+	struct Worker workers[jobs];
+	size_t started;
+	for (started = 0; started < jobs; started++) {
+		workers[started] = (struct Worker){ &sched, started };
+		int err = pthread_create(
+				&threads[started], NULL, run_worker, &workers[started]);
 		if (err != 0) {
-			printf_error("error creating thread #%d: %s", i, strerror(err));
-			return false;
+			printf_error("error creating thread #%zu: %s",
+					started, strerror(err));
+			ok = false;
+			break;
 		}
+		pin_worker(params, threads[started], started);
 	}
 
-	// In interactive mode, update results until all tasks are finished.
-	if (params->interactive) {
-		unsigned short count;
-		while ((count = test_count) < N_TOTAL_TESTS) {
+	// In interactive mode, update results until all tests are finished.
+	if (ok && params->interactive) {
+		unsigned long long count;
+		while ((count = sched.test_count) < n_tests) {
 			update_progress(results, count);
 			usleep(UPDATE_DELAY_MS * 1000);
 		}
 		update_progress(results, count);
 	}
 
-	// Join all the threads and return.
-	for (size_t i = 0; i < jobs; i++) {
+	// Join the threads and clean up. Even after an error, the threads that
+	// started will finish all the chunks by stealing.
+	for (size_t i = 0; i < started; i++) {
 		int err = pthread_join(threads[i], NULL);
 		if (err != 0) {
-			printf_error("error joining thread #%d: %s", i, strerror(err));
+			printf_error("error joining thread #%zu: %s", i, strerror(err));
+			ok = false;
+		}
+	}
+	for (size_t i = 0; i < jobs; i++) {
+		pthread_mutex_destroy(&sched.deques[i].mutex);
+		free(sched.deques[i].chunks);
+	}
+	free(sched.deques);
+	return ok;
+}
+
+// A task sent to an isolated worker process over its pipe: 'iters' iterations
+// of the test 'tests[test]', starting from iteration 'first'.
+struct IsolatedTask {
+	int test;
+	long long first;
+	long long iters;
+};
+
+// Shared memory where an isolated worker leaves the result of its task. The
+// 'current' field is the iteration it is running, so that a crash or deadline
+// can be attributed to it.
+struct IsolatedSlot {
+	atomic_llong current;
+	enum State state;
+	struct Timing timing;
+};
+
+// The supervisor's view of an isolated worker process.
+struct IsolatedWorker {
+	pid_t pid;
+	int task_fd;           // write end of the task pipe
+	int done_fd;           // read end of the done pipe
+	struct Chunk chunk;    // chunk being run, if 'busy'
+	bool busy;
+	long long started_ns;  // when the chunk was sent
+};
+
+// Shared state for 'run_isolated'.
+struct Supervisor {
+	struct Scheduler sched;           // results and the test counter
+	struct Test *tests;
+	struct IsolatedWorker *workers;
+	struct IsolatedSlot *slots;       // one per worker, in shared memory
+	size_t n_workers;
+	long long deadline_ns;            // time limit for one chunk
+	int watchdog_ms;                  // watchdog interval for the workers
+	const struct Parameters *params;  // for pinning the workers
+};
+
+// Reads exactly 'size' bytes, retrying on interrupts. Returns false on end of
+// file or error.
+static bool read_full(int fd, void *buf, size_t size) {
+	char *p = buf;
+	while (size > 0) {
+		ssize_t n = read(fd, p, size);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			return false;
+		}
+		p += n;
+		size -= (size_t)n;
+	}
+	return true;
+}
+
+// Writes exactly 'size' bytes, retrying on interrupts. Returns false on error.
+static bool write_full(int fd, const void *buf, size_t size) {
+	const char *p = buf;
+	while (size > 0) {
+		ssize_t n = write(fd, p, size);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			return false;
+		}
+		p += n;
+		size -= (size_t)n;
+	}
+	return true;
+}
+
+// Main loop of an isolated worker process. Runs tasks from 'task_fd' one
+// iteration at a time, keeping 'slot->current' up to date, then stores the
+// result in 'slot' and writes a byte to 'done_fd'. Exits when the supervisor
+// closes the task pipe.
+_Noreturn static void run_isolated_worker(const struct Test *tests, int task_fd,
+		int done_fd, struct IsolatedSlot *slot) {
+	struct IsolatedTask task;
+	while (read_full(task_fd, &task, sizeof task)) {
+		const struct Test *test = &tests[task.test];
+		const enum State expected = test->positive ? PASS : FAIL;
+		enum State state = expected;
+		struct Timing total, timing;
+		memset(&total, 0, sizeof total);
+		for (long long i = task.first; i < task.first + task.iters; i++) {
+			atomic_store(&slot->current, i);
+			state = run_batch(test->problem, test->positive, i, 1, NULL,
+					&timing);
+			merge_timing(&total, &timing);
+			if (state != expected) {
+				break;
+			}
+		}
+		slot->state = state;
+		slot->timing = total;
+		if (!write_full(done_fd, "", 1)) {
+			break;
+		}
+	}
+	_exit(0);
+}
+
+// Forks the isolated worker 'index'. If there was an error, prints an error
+// message and returns false.
+static bool spawn_worker(struct Supervisor *sup, size_t index) {
+	int task_pipe[2], done_pipe[2];
+	if (pipe(task_pipe) != 0) {
+		printf_error("pipe: %s", strerror(errno));
+		return false;
+	}
+	if (pipe(done_pipe) != 0) {
+		printf_error("pipe: %s", strerror(errno));
+		close(task_pipe[0]);
+		close(task_pipe[1]);
+		return false;
+	}
+	fflush(stdout);
+	pid_t pid = fork();
+	if (pid < 0) {
+		printf_error("fork: %s", strerror(errno));
+		close(task_pipe[0]);
+		close(task_pipe[1]);
+		close(done_pipe[0]);
+		close(done_pipe[1]);
+		return false;
+	}
+	if (pid == 0) {
+		// Close the supervisor's ends of every pipe, so that each worker
+		// sees end of file when the supervisor closes its task pipe.
+		for (size_t i = 0; i < sup->n_workers; i++) {
+			if (i != index && sup->workers[i].pid > 0) {
+				close(sup->workers[i].task_fd);
+				close(sup->workers[i].done_fd);
+			}
+		}
+		close(task_pipe[1]);
+		close(done_pipe[0]);
+		// Threads do not survive the fork, so each worker needs its own.
+		if (sup->watchdog_ms > 0
+				&& !watchdog_start(sup->watchdog_ms, WATCHDOG_EVENTS)) {
+			_exit(1);
+		}
+		pin_worker(sup->params, pthread_self(), index);
+		run_isolated_worker(sup->tests, task_pipe[0], done_pipe[1],
+				&sup->slots[index]);
+	}
+	close(task_pipe[0]);
+	close(done_pipe[1]);
+	struct IsolatedWorker *w = &sup->workers[index];
+	w->pid = pid;
+	w->task_fd = task_pipe[1];
+	w->done_fd = done_pipe[0];
+	w->busy = false;
+	return true;
+}
+
+// Kills the isolated worker 'index' (if it is still running) and reaps it.
+static void reap_worker(struct Supervisor *sup, size_t index) {
+	struct IsolatedWorker *w = &sup->workers[index];
+	kill(w->pid, SIGKILL);
+	waitpid(w->pid, NULL, 0);
+	close(w->task_fd);
+	close(w->done_fd);
+	w->pid = 0;
+	w->busy = false;
+}
+
+// Records that a chunk finished with 'state' and the given timing, which may
+// be NULL. The first chunk to reach an unexpected state decides the test.
+static void complete_chunk(struct Supervisor *sup, struct Chunk chunk,
+		enum State state, const struct Timing *timing) {
+	struct Test *test = chunk.test;
+	int expected = test->positive ? PASS : FAIL;
+	if ((int)state != expected) {
+		atomic_compare_exchange_strong(&test->state, &expected, (int)state);
+	}
+	if (timing) {
+		add_timing(test->problem, test->positive, timing);
+	}
+	if (atomic_fetch_sub(&test->pending, 1) == 1) {
+		finish_test(&sup->sched, test);
+	}
+}
+
+// Handles an isolated worker that crashed or missed its deadline while running
+// a chunk: counts the chunk as 'state' at the current iteration, and replaces
+// the worker. Returns false if the worker could not be replaced.
+static bool replace_worker(struct Supervisor *sup, size_t index,
+		enum State state) {
+	struct IsolatedWorker *w = &sup->workers[index];
+	struct Chunk chunk = w->chunk;
+	bool busy = w->busy;
+	long long started_ns = w->started_ns;
+	reap_worker(sup, index);
+	if (busy) {
+		struct Timing timing;
+		memset(&timing, 0, sizeof timing);
+		timing.start_ns = started_ns;
+		timing.end_ns = monotonic_ns();
+		timing.failed_at = atomic_load(&sup->slots[index].current) + 1;
+		complete_chunk(sup, chunk, state, &timing);
+	}
+	return spawn_worker(sup, index);
+}
+
+// Sends the next chunk to the idle isolated worker 'index', skipping chunks of
+// tests that are already decided. If the worker has crashed, the write fails
+// and the crash is noticed later by 'poll'.
+static void dispatch_chunk(struct Supervisor *sup, size_t index,
+		struct Chunk *chunks, size_t n_chunks, size_t *next) {
+	while (*next < n_chunks) {
+		struct Chunk chunk = chunks[(*next)++];
+		int expected = chunk.test->positive ? PASS : FAIL;
+		if (atomic_load(&chunk.test->state) != expected) {
+			complete_chunk(sup, chunk, (enum State)expected, NULL);
+			continue;
+		}
+		struct IsolatedWorker *w = &sup->workers[index];
+		struct IsolatedTask task = {
+			.test = (int)(chunk.test - sup->tests),
+			.first = chunk.first,
+			.iters = chunk.iters
+		};
+		atomic_store(&sup->slots[index].current, chunk.first);
+		w->chunk = chunk;
+		w->busy = true;
+		w->started_ns = monotonic_ns();
+		write_full(w->task_fd, &task, sizeof task);
+		return;
+	}
+}
+
+// Runs the tests specified by 'params' in 'params->jobs' worker processes,
+// storing results in the 'results' array. The supervisor splits the tests into
+// chunks like 'run_parallel', sends them to idle workers over pipes, and
+// collects their results through shared memory. A worker that crashes fails
+// its test, and one that takes longer than 'params->deadline_ms' on a chunk is
+// killed and times out its test; either way it is replaced. Clears the screen
+// and updates results periodically if 'params->interactive' is true. If there
+// was an error, prints an error message and returns false.
+static bool run_isolated(
+		const struct Parameters *params, struct Result *results) {
+	const bool all = params->problem == ALL_PROBLEMS;
+	const int first = all ? 1 : params->problem;
+	const size_t n_tests = (all ? N_PROBLEMS : 1) * 2;
+	const size_t n_workers = (size_t)params->jobs;
+
+	struct Supervisor sup = {
+		.sched = {
+			.n_workers = 0,
+			.deques = NULL,
+			.results = results,
+			.results_mutex = PTHREAD_MUTEX_INITIALIZER,
+			.test_count = 0
+		},
+		.workers = calloc(n_workers, sizeof *sup.workers),
+		.n_workers = n_workers,
+		.deadline_ns = params->deadline_ms * 1000000LL,
+		.watchdog_ms = params->watchdog_ms,
+		.params = params
+	};
+	sup.slots = mmap(NULL, n_workers * sizeof *sup.slots,
+			PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (sup.slots == MAP_FAILED) {
+		printf_error("mmap: %s", strerror(errno));
+		free(sup.workers);
+		return false;
+	}
+
+	// Split the tests into chunks, in order.
+	struct Test tests[n_tests];
+	sup.tests = tests;
+	size_t n_chunks =
+		total_chunk_count(first, n_tests / 2, params->pos_iters);
+	struct Chunk *chunks = malloc(MAX(1, n_chunks) * sizeof *chunks);
+	n_chunks = 0;
+	for (size_t i = 0; i < n_tests; i++) {
+		struct Test *test = &tests[i];
+		test->problem = first + (int)(i / 2);
+		test->positive = i % 2 == 0;
+		long long iters = test->positive ? params->pos_iters
+			: neg_iters_for[PROBLEM_TO_INDEX(test->problem)];
+		size_t count = chunk_count(iters);
+		atomic_init(&test->state, test->positive ? PASS : FAIL);
+		atomic_init(&test->pending, (int)count);
+		if (count == 0) {
+			atomic_store(&test->state, SKIP);
+			finish_test(&sup.sched, test);
+		}
+		for (size_t j = 0; j < count; j++) {
+			chunks[n_chunks++] = make_chunk(test, iters, j);
+		}
+	}
+
+	// Writing to the pipe of a crashed worker must not kill the supervisor.
+	void (*old_sigpipe)(int) = signal(SIGPIPE, SIG_IGN);
+	bool ok = true;
+	for (size_t i = 0; i < n_workers && ok; i++) {
+		ok = spawn_worker(&sup, i);
+	}
+
+	size_t next = 0;
+	struct pollfd fds[n_workers];
+	while (ok && sup.sched.test_count < n_tests) {
+		for (size_t i = 0; i < n_workers; i++) {
+			if (!sup.workers[i].busy) {
+				dispatch_chunk(&sup, i, chunks, n_chunks, &next);
+			}
+		}
+
+		// Wait for a worker to finish, but no longer than the nearest
+		// deadline (or the update delay, in interactive mode).
+		long long now = monotonic_ns();
+		long long wait_ns = params->interactive
+			? UPDATE_DELAY_MS * 1000000LL : sup.deadline_ns;
+		for (size_t i = 0; i < n_workers; i++) {
+			fds[i] = (struct pollfd){ sup.workers[i].done_fd, POLLIN, 0 };
+			if (sup.workers[i].busy) {
+				long long left =
+					sup.workers[i].started_ns + sup.deadline_ns - now;
+				wait_ns = MIN(wait_ns, MAX(0, left));
+			}
+		}
+		int n = poll(fds, (nfds_t)n_workers, (int)(wait_ns / 1000000) + 1);
+		if (n < 0 && errno != EINTR) {
+			printf_error("poll: %s", strerror(errno));
+			ok = false;
+			break;
+		}
+
+		now = monotonic_ns();
+		for (size_t i = 0; i < n_workers && ok; i++) {
+			struct IsolatedWorker *w = &sup.workers[i];
+			if (n > 0 && fds[i].revents) {
+				char byte;
+				if (w->busy && read_full(w->done_fd, &byte, 1)) {
+					struct IsolatedSlot *slot = &sup.slots[i];
+					w->busy = false;
+					complete_chunk(&sup, w->chunk, slot->state, &slot->timing);
+				} else {
+					ok = replace_worker(&sup, i, CRASH);
+				}
+			} else if (w->busy && now - w->started_ns > sup.deadline_ns) {
+				ok = replace_worker(&sup, i, TIMEOUT);
+			}
+		}
+		if (params->interactive) {
+			update_progress(results, sup.sched.test_count);
+		}
+	}
+
+	// Close the task pipes so that the workers exit, and reap them.
+	for (size_t i = 0; i < n_workers; i++) {
+		struct IsolatedWorker *w = &sup.workers[i];
+		if (w->pid > 0) {
+			close(w->task_fd);
+			close(w->done_fd);
+			waitpid(w->pid, NULL, 0);
+		}
+	}
+	signal(SIGPIPE, old_sigpipe);
+	munmap(sup.slots, n_workers * sizeof *sup.slots);
+	free(sup.workers);
+	free(chunks);
+	return ok;
+}
+
+// Soak progress of one problem.
+struct SoakProblem {
+	atomic_ullong next_iter;  // number of the next iteration to hand out
+	atomic_int state;         // PASS until an iteration fails or times out
+};
+
+// Shared state for the workers in 'run_soak'.
+struct Soak {
+	int first;                     // first problem to run
+	int n_problems;                // number of problems to run
+	long long deadline_ns;         // when to stop starting new chunks
+	atomic_uint next;              // counter for picking problems in turn
+	atomic_ullong total;           // iterations finished over all problems
+	atomic_uint running;           // number of workers still running
+	atomic_uint jobs;              // number of workers that have started
+	struct SoakProblem *problems;  // indexed by 'PROBLEM_TO_INDEX'
+};
+
+// Returns the next problem for a soak worker, taking them in turn and skipping
+// those that have already failed. Returns 0 if they have all failed.
+static int next_soak_problem(struct Soak *soak) {
+	for (int i = 0; i < soak->n_problems; i++) {
+		unsigned k = atomic_fetch_add(&soak->next, 1);
+		int problem = soak->first + (int)(k % (unsigned)soak->n_problems);
+		struct SoakProblem *p = &soak->problems[PROBLEM_TO_INDEX(problem)];
+		if (atomic_load(&p->state) == PASS) {
+			return problem;
+		}
+	}
+	return 0;
+}
+
+// Runs chunks of positive iterations for the Soak 'arg' until the deadline
+// passes or every problem has failed. Always returns NULL.
+static void *run_soak_worker(void *arg) {
+	struct Soak *soak = arg;
+	job_index = (int)atomic_fetch_add(&soak->jobs, 1);
+	int problem;
+	while (monotonic_ns() < soak->deadline_ns
+			&& (problem = next_soak_problem(soak)) != 0) {
+		struct SoakProblem *p = &soak->problems[PROBLEM_TO_INDEX(problem)];
+		long long base =
+			(long long)atomic_fetch_add(&p->next_iter, SOAK_CHUNK_ITERS);
+		struct Timing timing;
+		enum State state =
+			run_batch(problem, true, 0, SOAK_CHUNK_ITERS, NULL, &timing);
+		if (timing.failed_at != 0) {
+			timing.failed_at += base;
+		}
+		add_timing(problem, true, &timing);
+		atomic_fetch_add(&soak->total, timing.latency.count);
+		if (state != PASS) {
+			int expected = PASS;
+			atomic_compare_exchange_strong(&p->state, &expected, (int)state);
+		}
+	}
+	atomic_fetch_sub(&soak->running, 1);
+	return NULL;
+}
+
+// Runs the positive tests of the problems specified by 'params' continuously
+// for 'params->duration_s' seconds on 'params->jobs' threads. Prints the total
+// iterations and throughput periodically, then the results for each problem,
+// including where each failure happened. A problem that fails or times out is
+// not run again. Returns false if there was a pthread error or any problem
+// failed.
+static bool run_soak(const struct Parameters *params) {
+	const bool all = params->problem == ALL_PROBLEMS;
+	const int first = all ? 1 : params->problem;
+	const int last = all ? N_PROBLEMS : params->problem;
+	struct SoakProblem problems[N_PROBLEMS];
+	for (size_t i = 0; i < N_PROBLEMS; i++) {
+		atomic_init(&problems[i].next_iter, 0);
+		atomic_init(&problems[i].state, PASS);
+	}
+	const long long start_ns = monotonic_ns();
+	struct Soak soak = {
+		.first = first,
+		.n_problems = last - first + 1,
+		.deadline_ns = start_ns + params->duration_s * 1000000000LL,
+		.problems = problems
+	};
+	atomic_init(&soak.next, 0);
+	atomic_init(&soak.total, 0);
+	atomic_init(&soak.running, 0);
+	atomic_init(&soak.jobs, 0);
+
+	const size_t jobs = (size_t)MAX(1, params->jobs);
+	bool ok = true;
+	pthread_t threads[jobs];
+	size_t started;
+	for (started = 0; started < jobs; started++) {
+		atomic_fetch_add(&soak.running, 1);
+		int err = pthread_create(&threads[started], NULL, run_soak_worker,
+				&soak);
+		if (err != 0) {
+			atomic_fetch_sub(&soak.running, 1);
+			printf_error("error creating thread #%zu: %s",
+					started, strerror(err));
+			ok = false;
+			break;
+		}
+		pin_worker(params, threads[started], started);
+	}
+
+	// Print the throughput every so often until the deadline, or until the
+	// workers stop early because every problem failed.
+	const long long report_ns = MIN(MAX_SOAK_REPORT_S, MAX(MIN_SOAK_REPORT_S,
+			params->duration_s / 10)) * 1000000000LL;
+	printf("Soak: %d problem%s on %zu job%s for %d s\n", soak.n_problems,
+			soak.n_problems == 1 ? "" : "s", started, started == 1 ? "" : "s",
+			params->duration_s);
+	printf(" Elapsed s      Iterations       It/s\n");
+	printf("========== =============== ==========\n");
+	unsigned long long last_total = 0;
+	long long last_ns = start_ns;
+	long long now = start_ns;
+	while (ok && now < soak.deadline_ns && atomic_load(&soak.running) > 0) {
+		long long wake_ns = MIN(last_ns + report_ns, soak.deadline_ns);
+		while ((now = monotonic_ns()) < wake_ns
+				&& atomic_load(&soak.running) > 0) {
+			usleep((useconds_t)MIN((wake_ns - now) / 1000,
+					UPDATE_DELAY_MS * 1000));
+		}
+		unsigned long long total = atomic_load(&soak.total);
+		printf("%10.0lf %15llu %10.0lf\n", (now - start_ns) / 1e9, total,
+				(total - last_total) / ((now - last_ns) / 1e9));
+		fflush(stdout);
+		last_total = total;
+		last_ns = now;
+	}
+	for (size_t i = 0; i < started; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	if (!ok) {
+		return false;
+	}
+
+	// Print the results of each problem, and where the failures were.
+	struct Result results[N_PROBLEMS];
+	bool good = true;
+	printf("\n");
+	print_header();
+	for (int problem = first; problem <= last; problem++) {
+		enum State state = (enum State)atomic_load(
+				&problems[PROBLEM_TO_INDEX(problem)].state);
+		results[PROBLEM_TO_INDEX(problem)] = (struct Result){
+			.pos_state = state,
+			.neg_state = SKIP
+		};
+		print_result(problem, results[PROBLEM_TO_INDEX(problem)]);
+		good = good && !state_bad(state);
+	}
+	const double elapsed_s = (monotonic_ns() - start_ns) / 1e9;
+	const unsigned long long total = atomic_load(&soak.total);
+	printf("Total: %llu iterations in %.0lf s (%.0lf it/s).\n", total,
+			elapsed_s, total / elapsed_s);
+	for (int problem = first; problem <= last; problem++) {
+		struct Timing t = get_timing(problem, true);
+		if (t.failed_at != 0) {
+			printf("%02d. %s: first failure at iteration %lld (%s)\n",
+					problem, get_problem_name(problem), t.failed_at,
+					state_name(results[PROBLEM_TO_INDEX(problem)].pos_state));
+		}
+	}
+	return good;
+}
+
+// Maximum length of the configuration line in an estimates file.
+#define ESTIMATES_CONFIG_SIZE 256
+
+// Names of the semaphore backends, indexed by 'enum SemaBackend'.
+static const char *const backend_names[] = { "futex", "fifo", "eventfd" };
+
+// Writes the configuration that failure rates depend on into 'config': the
+// semaphore backend, the placement policy, and the problem settings.
+static void estimates_config(const struct Parameters *params, char *config) {
+	snprintf(config, ESTIMATES_CONFIG_SIZE, "backend=%s place=%s set=%s",
+			backend_names[sema_get_backend()],
+			params->placement ? params->placement : "none",
+			params->settings ? params->settings : "none");
+}
+
+// Shared state for the workers in 'run_estimates'.
+struct Estimator {
+	atomic_int next;               // next problem to estimate
+	int last;                      // last problem to estimate
+	long long budget_ns;           // time limit for each problem
+	struct Estimate *estimates;    // indexed by 'PROBLEM_TO_INDEX'
+};
+
+// Runs iterations of the negative test of 'problem' until the estimate of its
+// failure rate is precise enough or 'budget_ns' nanoseconds pass, whichever
+// comes first. Unlike 'test_negative', it does not stop at the first failure.
+static struct Estimate estimate_problem(int problem, long long budget_ns) {
+	ProblemFn function = get_problem_function(problem);
+	struct Estimate e = { 0, 0 };
+	begin_iterations();
+	const long long deadline_ns = monotonic_ns() + budget_ns;
+	while (!estimate_precise(e) && monotonic_ns() < deadline_ns) {
+		if (!function(false)) {
+			e.failures++;
+		}
+		e.trials++;
+		arena_reset();
+	}
+	end_iterations(problem, (long long)e.trials);
+	return e;
+}
+
+// Estimates problems for the Estimator 'arg' until there are none left.
+// Always returns NULL.
+static void *run_estimator(void *arg) {
+	struct Estimator *est = arg;
+	int problem;
+	while ((problem = atomic_fetch_add(&est->next, 1)) <= est->last) {
+		est->estimates[PROBLEM_TO_INDEX(problem)] =
+			estimate_problem(problem, est->budget_ns);
+	}
+	return NULL;
+}
+
+// Prints the failure-rate estimates for the problems in the range ['first',
+// 'last'], and how many negative iterations each needs to fail reliably.
+static void print_estimates(
+		const struct Estimate *estimates, int first, int last) {
+	printf("No. Problem name            Trials  Fails   Rate  95%% interval"
+			"   Needed\n");
+	printf("=== ======================= ====== ====== ====== ============="
+			"   ======\n");
+	for (int problem = first; problem <= last; problem++) {
+		struct Estimate e = estimates[PROBLEM_TO_INDEX(problem)];
+		const char *name = get_problem_name(problem);
+		double low, high;
+		estimate_interval(e, &low, &high);
+		printf("%02d. %s %s %6lu %6lu %5.1lf%% %5.1lf%%-%5.1lf%%", problem,
+				name, padding_dots + strlen(name), e.trials, e.failures,
+				e.trials ? 100.0 * e.failures / e.trials : 0.0,
+				100 * low, 100 * high);
+		long long needed = estimate_iterations(e, LLONG_MAX);
+		if (needed == LLONG_MAX) {
+			printf("        -\n");
+		} else {
+			printf("   %6lld\n", needed);
+		}
+	}
+}
+
+// Estimates how often the negative test of each problem specified by 'params'
+// fails, running problems in parallel on 'params->jobs' threads, and prints
+// the estimates. Saves them to 'params->estimates' if it is set. If there was
+// an error, prints an error message and returns false.
+static bool run_estimates(const struct Parameters *params) {
+	const bool all = params->problem == ALL_PROBLEMS;
+	const int first = all ? 1 : params->problem;
+	const int last = all ? N_PROBLEMS : params->problem;
+	struct Estimate estimates[N_PROBLEMS] = { { 0, 0 } };
+	struct Estimator est = {
+		.last = last,
+		.budget_ns = params->estimate_ms * 1000000LL,
+		.estimates = estimates
+	};
+	atomic_init(&est.next, first);
+
+	const size_t jobs = (size_t)MAX(1, MIN(params->jobs, last - first + 1));
+	bool ok = true;
+	pthread_t threads[jobs];
+	size_t started;
+	for (started = 0; started < jobs; started++) {
+		int err = pthread_create(&threads[started], NULL, run_estimator, &est);
+		if (err != 0) {
+			printf_error("error creating thread #%zu: %s",
+					started, strerror(err));
+			ok = false;
+			break;
+		}
+		pin_worker(params, threads[started], started);
+	}
+	for (size_t i = 0; i < started; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	if (!ok) {
+		return false;
+	}
+	print_estimates(estimates, first, last);
+	if (params->estimates) {
+		char config[ESTIMATES_CONFIG_SIZE];
+		estimates_config(params, config);
+		// Keep the estimates of the other problems when only one was run.
+		struct Estimate saved[N_PROBLEMS];
+		if (!all && access(params->estimates, F_OK) == 0) {
+			if (!estimates_load(params->estimates, config, saved,
+						N_PROBLEMS)) {
+				return false;
+			}
+			saved[PROBLEM_TO_INDEX(first)] = estimates[PROBLEM_TO_INDEX(first)];
+			return estimates_save(params->estimates, config, saved,
+					N_PROBLEMS);
+		}
+		return estimates_save(params->estimates, config, estimates,
+				N_PROBLEMS);
+	}
+	return true;
+}
+
+// Sets the number of negative iterations for each problem from 'params'. If
+// 'params->estimates' is set, loads it and lowers each problem's iterations to
+// what its estimate says it needs. If there was an error, prints an error
+// message and returns false.
+static bool plan_negative_iterations(const struct Parameters *params) {
+	struct Estimate estimates[N_PROBLEMS];
+	if (params->estimates) {
+		char config[ESTIMATES_CONFIG_SIZE];
+		estimates_config(params, config);
+		if (!estimates_load(params->estimates, config, estimates,
+					N_PROBLEMS)) {
 			return false;
 		}
 	}
+	for (size_t i = 0; i < N_PROBLEMS; i++) {
+		neg_iters_for[i] = params->estimates
+			? estimate_iterations(estimates[i], params->neg_iters)
+			: params->neg_iters;
+	}
 	return true;
 }
 
+// Writes 's' as a JSON string, escaping quotes, backslashes, and control
+// characters, or writes null if 's' is null.
+static void write_json_string(FILE *out, const char *s) {
+	if (!s) {
+		fprintf(out, "null");
+		return;
+	}
+	fputc('"', out);
+	for (; *s; s++) {
+		unsigned char c = (unsigned char)*s;
+		if (c == '"' || c == '\\') {
+			fprintf(out, "\\%c", c);
+		} else if (c < 0x20) {
+			fprintf(out, "\\u%04x", c);
+		} else {
+			fputc(c, out);
+		}
+	}
+	fputc('"', out);
+}
+
+// Writes 's' as a quoted CSV field, doubling any quotes in it.
+static void write_csv_string(FILE *out, const char *s) {
+	fputc('"', out);
+	for (; *s; s++) {
+		if (*s == '"') {
+			fputc('"', out);
+		}
+		fputc(*s, out);
+	}
+	fputc('"', out);
+}
+
+// Writes the results of one test as the members of a JSON object.
+static void write_json_test(FILE *out, int problem, bool positive,
+		enum State state) {
+	struct Timing t = get_timing(problem, positive);
+	struct TimingReport r = report_timing(&t);
+	fprintf(out, "{\"state\": \"%s\", \"iterations\": %llu, "
+			"\"first_failure\": ", state_name(state), r.iterations);
+	if (r.first_failure < 0) {
+		fprintf(out, "null");
+	} else {
+		fprintf(out, "%lld", r.first_failure);
+	}
+	fprintf(out, ", \"wall_s\": %.6lf, \"cpu_s\": %.6lf, "
+			"\"iters_per_s\": %.3lf, \"p50_us\": %.3lf, \"p99_us\": %.3lf, "
+			"\"max_us\": %.3lf}", r.wall_s, r.cpu_s, r.iters_per_s,
+			r.p50_us, r.p99_us, r.max_us);
+}
+
+// Writes the CPU placement in 'params' as a JSON value.
+static void write_json_placement(FILE *out, const struct Parameters *params) {
+	if (!params->placement) {
+		fprintf(out, "null");
+		return;
+	}
+	fprintf(out, "{\"policy\": ");
+	write_json_string(out, params->placement);
+	fprintf(out, ", \"cpus\": [");
+	for (int i = 0; i < params->n_cpus; i++) {
+		fprintf(out, "%s%d", i == 0 ? "" : ", ", params->cpus[i]);
+	}
+	fprintf(out, "]}");
+}
+
+// Writes the results for the problems in the range ['first', 'last'] as a JSON
+// object with an array of problems, the CPU placement, the problem parameter
+// settings, and a summary.
+static void write_json(FILE *out, const struct Parameters *params,
+		const struct Result *results, int first, int last) {
+	int counts[N_STATES] = { 0 };
+	fprintf(out, "{\n  \"problems\": [\n");
+	for (int problem = first; problem <= last; problem++) {
+		struct Result result = results[PROBLEM_TO_INDEX(problem)];
+		counts[result.pos_state]++;
+		counts[result.neg_state]++;
+		fprintf(out, "    {\"problem\": %d, \"name\": ", problem);
+		write_json_string(out, get_problem_name(problem));
+		fprintf(out, ",\n");
+		fprintf(out, "     \"positive\": ");
+		write_json_test(out, problem, true, result.pos_state);
+		fprintf(out, ",\n     \"negative\": ");
+		write_json_test(out, problem, false, result.neg_state);
+		fprintf(out, "}%s\n", problem == last ? "" : ",");
+	}
+	fprintf(out, "  ],\n  \"placement\": ");
+	write_json_placement(out, params);
+	fprintf(out, ",\n  \"settings\": ");
+	write_json_string(out, params->settings);
+	fprintf(out, ",\n  \"summary\": {\"passed\": %d, \"failed\": %d, "
+			"\"timed_out\": %d, \"crashed\": %d, \"skipped\": %d}\n}\n",
+			counts[PASS], counts[FAIL], counts[TIMEOUT], counts[CRASH],
+			counts[SKIP]);
+}
+
+// Writes the results for the problems in the range ['first', 'last'] as CSV,
+// with a header row and then one row per test. Every row ends with the CPU
+// placement policy and the CPUs it chose, separated by spaces.
+static void write_csv(FILE *out, const struct Parameters *params,
+		const struct Result *results, int first, int last) {
+	fprintf(out, "problem,name,polarity,state,iterations,first_failure,"
+			"wall_s,cpu_s,iters_per_s,p50_us,p99_us,max_us,placement,cpus\n");
+	for (int problem = first; problem <= last; problem++) {
+		struct Result result = results[PROBLEM_TO_INDEX(problem)];
+		for (int i = 0; i < 2; i++) {
+			bool positive = i == 0;
+			struct Timing t = get_timing(problem, positive);
+			struct TimingReport r = report_timing(&t);
+			fprintf(out, "%d,", problem);
+			write_csv_string(out, get_problem_name(problem));
+			fprintf(out, ",%s,%s,%llu,", positive ? "positive" : "negative",
+					state_name(positive ? result.pos_state : result.neg_state),
+					r.iterations);
+			if (r.first_failure >= 0) {
+				fprintf(out, "%lld", r.first_failure);
+			}
+			fprintf(out, ",%.6lf,%.6lf,%.3lf,%.3lf,%.3lf,%.3lf,", r.wall_s,
+					r.cpu_s, r.iters_per_s, r.p50_us, r.p99_us, r.max_us);
+			write_csv_string(out,
+					params->placement ? params->placement : "");
+			fputc(',', out);
+			for (int j = 0; j < params->n_cpus; j++) {
+				fprintf(out, "%s%d", j == 0 ? "" : " ", params->cpus[j]);
+			}
+			fprintf(out, "\n");
+		}
+	}
+}
+
+// Writes the results for the problems in the range ['first', 'last'] in the
+// format given by 'params', to 'params->output' or to stdout. Does nothing for
+// the table format. If the file cannot be written, prints an error message and
+// returns false.
+static bool write_results(const struct Parameters *params,
+		const struct Result *results, int first, int last) {
+	if (params->format == FORMAT_TABLE) {
+		return true;
+	}
+	FILE *out = stdout;
+	if (params->output) {
+		out = fopen(params->output, "w");
+		if (out == NULL) {
+			printf_error("%s: %s", params->output, strerror(errno));
+			return false;
+		}
+	}
+	if (params->format == FORMAT_JSON) {
+		write_json(out, params, results, first, last);
+	} else {
+		write_csv(out, params, results, first, last);
+	}
+	bool ok = !ferror(out);
+	if (out != stdout && fclose(out) != 0) {
+		ok = false;
+	}
+	if (!ok) {
+		printf_error("%s: write error", params->output ? params->output
+				: "stdout");
+	}
+	return ok;
+}
+
 bool run_tests(const struct Parameters *params) {
 	assert(params->problem >= 0);
 	assert(params->pos_iters >= 0);
 	assert(params->neg_iters >= 0);
 	assert(!(params->problem != ALL_PROBLEMS && params->interactive));
 
-	// Run tests synchronously if there is only one test to run.
-	if (params->problem != ALL_PROBLEMS) {
-		struct Result result = test_problem(
-				params->problem, params->pos_iters, params->neg_iters);
-		print_header();
-		print_result(params->problem, result);
-		return result_good(result);
+	const bool table = shows_table(params);
+
+	// Pin the calling thread like the first worker, since it runs the tests
+	// itself when there is one job, and tell the pool where roles go.
+	pin_worker(params, pthread_self(), 0);
+	pool_set_cpus(params->cpus, params->n_cpus);
+	if (table && params->placement) {
+		printf("Placement: %s (CPUs", params->placement);
+		for (int i = 0; i < params->n_cpus; i++) {
+			printf(" %d", params->cpus[i]);
+		}
+		printf(")\n");
+	}
+	if (table && params->settings) {
+		printf("Settings: %s\n", params->settings);
+	}
+
+	// Isolated workers start their own watchdogs.
+	if (params->watchdog_ms > 0 && !params->isolate
+			&& !watchdog_start(params->watchdog_ms, WATCHDOG_EVENTS)) {
+		return false;
+	}
+
+	if (params->estimate_ms > 0) {
+		return run_estimates(params);
+	}
+	if (params->duration_s > 0) {
+		return run_soak(params);
+	}
+	if (!plan_negative_iterations(params)) {
+		return false;
 	}
 
 	// Allocate the results array (use 'calloc' because PENDING is 0).
 	struct Result *results = calloc(N_PROBLEMS, sizeof *results);
 
+	// Run tests synchronously if there is only one problem to test, unless
+	// there are multiple jobs to split its iterations between.
+	if (params->problem != ALL_PROBLEMS) {
+		const int problem = params->problem;
+		struct Result *result = &results[PROBLEM_TO_INDEX(problem)];
+		if (params->isolate) {
+			if (!run_isolated(params, results)) {
+				free(results);
+				return false;
+			}
+		} else if (params->jobs == 1) {
+			*result = test_problem(problem, params->pos_iters,
+					neg_iters_for[PROBLEM_TO_INDEX(problem)]);
+		} else if (!run_parallel(params, results)) {
+			free(results);
+			return false;
+		}
+		if (table) {
+			print_header();
+			print_result(problem, *result);
+			print_spin_report();
+			print_stats_report(problem, problem);
+			print_metrics_report(problem, problem);
+			if (params->allocs) {
+				print_alloc_report(problem, problem);
+			}
+		}
+		bool status = write_results(params, results, problem, problem)
+			&& result_good(*result);
+		free(results);
+		return status;
+	}
+
 	// If this is interactive mode, open the alternative terminal screen.
 	if (params->interactive) {
 		open_alt_screen();
 		clear_screen();
 	}
 
-	// Run the tests, sequentially or in parallel.
-	if (params->jobs == 1) {
+	// Run the tests, sequentially, in parallel, or in worker processes.
+	if (params->isolate) {
+		if (!run_isolated(params, results)) {
+			free(results);
+			return false;
+		}
+	} else if (params->jobs == 1) {
 		run_sequential(params, results);
 	} else if (!run_parallel(params, results)) {
 		free(results);
@@ -328,12 +1821,21 @@ bool run_tests(const struct Parameters *params) {
 		while (getchar() != QUIT_CHARACTER);
 		close_alt_screen();
 	}
-	if (params->jobs != 1 || params->interactive) {
-		print_all_results(results);
+	if (table) {
+		if (params->jobs != 1 || params->interactive || params->isolate) {
+			print_all_results(results);
+		}
+		print_spin_report();
+		print_stats_report(1, N_PROBLEMS);
+		print_metrics_report(1, N_PROBLEMS);
+		if (params->allocs) {
+			print_alloc_report(1, N_PROBLEMS);
+		}
 	}
 
 	// Clean up and return.
-	bool status = all_results_good(results);
+	bool status = write_results(params, results, 1, N_PROBLEMS)
+		&& all_results_good(results);
 	free(results);
 	return status;
 }
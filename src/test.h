@@ -8,13 +8,33 @@
 // Integer constant that designates all problems rather than just one.
 #define ALL_PROBLEMS 0
 
+// Formats for the test results.
+enum Format {
+	FORMAT_TABLE,  // human-readable table
+	FORMAT_JSON,   // JSON object with one entry per problem
+	FORMAT_CSV     // CSV with one row per positive or negative test
+};
+
 // Parameters for testing solutions to exercise problems.
 struct Parameters {
-	int problem;       // problem number or ALL_PROBLEMS
-	int pos_iters;     // maximum number of iterations for the positive case
-	int neg_iters;     // maximum number of iterations for the negative case
-	int jobs;          // Number of parallel jobs to run
-	bool interactive;  // use interactive mode (updates in alternate screen)
+	int problem;         // problem number or ALL_PROBLEMS
+	long long pos_iters; // maximum number of iterations for the positive case
+	long long neg_iters; // maximum number of iterations for the negative case
+	int jobs;            // Number of parallel jobs to run
+	bool interactive;    // use interactive mode (updates in alternate screen)
+	enum Format format;  // format of the results
+	const char *output;  // file to write the results to, or NULL for stdout
+	bool isolate;        // run tests in worker processes
+	int deadline_ms;     // time limit for a chunk of iterations when isolated
+	int watchdog_ms;     // stall interval for the deadlock watchdog, or 0
+	int estimate_ms;     // time budget per problem to estimate failure rates
+	const char *estimates;  // file of failure-rate estimates, or NULL
+	int duration_s;      // run positive tests for this long (soak mode), or 0
+	const char *placement;  // CPU placement policy, or NULL for none
+	const int *cpus;     // CPUs that workers and roles are pinned to in turn
+	int n_cpus;          // number of CPUs in 'cpus'
+	const char *settings;  // problem parameters changed from defaults, or NULL
+	bool allocs;         // report allocations per iteration
 };
 
 // Runs tests according to the parameters. Returns true on success.
@@ -0,0 +1,183 @@
+// Copyright 2016 Mitchell Kember. Subject to the MIT License.
+
+#if defined(__linux__)
+#define _GNU_SOURCE
+#include <sched.h>
+#endif
+
+#include "topology.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Directory containing the Linux CPU topology.
+#define SYS_CPU_DIR "/sys/devices/system/cpu"
+
+// Reads a single integer from the file at 'path'. Returns false on failure.
+static bool read_int_file(const char *path, int *out) {
+	FILE *file = fopen(path, "r");
+	if (!file) {
+		return false;
+	}
+	bool ok = fscanf(file, "%d", out) == 1;
+	fclose(file);
+	return ok;
+}
+
+int parse_cpu_list(const char *str, int *out, int max) {
+	int n = 0;
+	while (*str && *str != '\n') {
+		char *end;
+		long first = strtol(str, &end, 10);
+		long last = first;
+		if (end == str || first < 0) {
+			return -1;
+		}
+		if (*end == '-') {
+			str = end + 1;
+			last = strtol(str, &end, 10);
+			if (end == str || last < first) {
+				return -1;
+			}
+		}
+		for (long cpu = first; cpu <= last; cpu++) {
+			if (n == max) {
+				return -1;
+			}
+			out[n++] = (int)cpu;
+		}
+		str = end;
+		if (*str == ',') {
+			str++;
+		} else if (*str && *str != '\n') {
+			return -1;
+		}
+	}
+	return n;
+}
+
+#if defined(__linux__)
+
+bool topo_load(struct Topology *topo) {
+	char line[1024];
+	FILE *file = fopen(SYS_CPU_DIR "/online", "r");
+	if (!file) {
+		return false;
+	}
+	bool ok = fgets(line, sizeof line, file) != NULL;
+	fclose(file);
+	int online[MAX_CPUS];
+	int n_online = ok ? parse_cpu_list(line, online, MAX_CPUS) : -1;
+	if (n_online <= 0) {
+		return false;
+	}
+
+	cpu_set_t allowed;
+	if (sched_getaffinity(0, sizeof allowed, &allowed) != 0) {
+		CPU_ZERO(&allowed);
+		for (int i = 0; i < n_online; i++) {
+			CPU_SET(online[i], &allowed);
+		}
+	}
+
+	topo->n_cpus = 0;
+	for (int i = 0; i < n_online; i++) {
+		int cpu = online[i];
+		if (!CPU_ISSET(cpu, &allowed)) {
+			continue;
+		}
+		char path[128];
+		int core_id, package_id;
+		snprintf(path, sizeof path, SYS_CPU_DIR "/cpu%d/topology/core_id", cpu);
+		if (!read_int_file(path, &core_id)) {
+			core_id = cpu;
+		}
+		snprintf(path, sizeof path,
+				SYS_CPU_DIR "/cpu%d/topology/physical_package_id", cpu);
+		if (!read_int_file(path, &package_id)) {
+			package_id = 0;
+		}
+		topo->cpu[topo->n_cpus] = cpu;
+		topo->core[topo->n_cpus] = package_id * 65536 + core_id;
+		topo->n_cpus++;
+	}
+	return topo->n_cpus > 0;
+}
+
+bool pin_thread(pthread_t thread, const int *cpus, int n) {
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (int i = 0; i < n; i++) {
+		CPU_SET(cpus[i], &set);
+	}
+	return pthread_setaffinity_np(thread, sizeof set, &set) == 0;
+}
+
+#else
+
+bool topo_load(struct Topology *topo) {
+	topo->n_cpus = 0;
+	return false;
+}
+
+bool pin_thread(pthread_t thread, const int *cpus, int n) {
+	(void)thread;
+	(void)cpus;
+	(void)n;
+	return false;
+}
+
+#endif
+
+int topo_choose(const struct Topology *topo, enum Placement placement,
+		int *out, int max) {
+	int n = 0;
+	switch (placement) {
+	case PLACE_ONE_CPU:
+		if (topo->n_cpus > 0 && max > 0) {
+			out[n++] = topo->cpu[0];
+		}
+		break;
+	case PLACE_SMT_SIBLINGS:
+		// Use the first core that has more than one logical CPU.
+		for (int i = 0; i < topo->n_cpus && n < 2; i++) {
+			n = 0;
+			for (int j = i; j < topo->n_cpus && n < max; j++) {
+				if (topo->core[j] == topo->core[i]) {
+					out[n++] = topo->cpu[j];
+				}
+			}
+		}
+		if (n < 2) {
+			n = 0;
+		}
+		break;
+	case PLACE_SPREAD:
+		for (int i = 0; i < topo->n_cpus && n < max; i++) {
+			bool seen = false;
+			for (int j = 0; j < i; j++) {
+				seen |= topo->core[j] == topo->core[i];
+			}
+			if (!seen) {
+				out[n++] = topo->cpu[i];
+			}
+		}
+		if (n < 2) {
+			n = 0;
+		}
+		break;
+	}
+	return n;
+}
+
+const char *placement_name(enum Placement placement) {
+	switch (placement) {
+	case PLACE_ONE_CPU:
+		return "one-cpu";
+	case PLACE_SMT_SIBLINGS:
+		return "smt";
+	case PLACE_SPREAD:
+		return "spread";
+	}
+	return NULL;
+}
@@ -0,0 +1,48 @@
+// Copyright 2016 Mitchell Kember. Subject to the MIT License.
+
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include <pthread.h>
+#include <stdbool.h>
+
+// Maximum number of logical CPUs we keep track of.
+#define MAX_CPUS 256
+
+// Logical CPU topology of the machine, restricted to the CPUs this process is
+// allowed to run on.
+struct Topology {
+	int n_cpus;              // number of usable logical CPUs
+	int cpu[MAX_CPUS];       // CPU numbers, in increasing order
+	int core[MAX_CPUS];      // physical core of each CPU (unique per package)
+};
+
+// Ways of choosing CPUs for a group of threads.
+enum Placement {
+	PLACE_ONE_CPU,       // all threads on the same logical CPU
+	PLACE_SMT_SIBLINGS,  // hyperthreads of a single physical core
+	PLACE_SPREAD         // one logical CPU per physical core
+};
+
+// Reads the topology from /sys/devices/system/cpu. Returns false if it is not
+// available (for example, on macOS).
+bool topo_load(struct Topology *topo);
+
+// Chooses up to 'max' CPUs according to 'placement', storing their numbers in
+// 'out'. Returns how many were chosen, which is zero if the placement cannot be
+// satisfied (for example, SMT siblings without hyperthreading).
+int topo_choose(const struct Topology *topo, enum Placement placement,
+		int *out, int max);
+
+// Returns a short name for the placement.
+const char *placement_name(enum Placement placement);
+
+// Parses a CPU list like "0-3,8,10-11" into 'out'. Returns the number of CPUs,
+// or -1 if the string is malformed or lists more than 'max' CPUs.
+int parse_cpu_list(const char *str, int *out, int max);
+
+// Restricts 'thread' to run on the 'n' CPUs in 'cpus'. Returns false if this is
+// not supported or fails.
+bool pin_thread(pthread_t thread, const int *cpus, int n);
+
+#endif
@@ -2,11 +2,13 @@
 
 #include "util.h"
 
+#include <errno.h>
 #include <signal.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <termios.h>
+#include <time.h>
 #include <unistd.h>
 
 // The name of the program.
@@ -30,6 +32,18 @@ void printf_error(const char *format, ...) {
 	va_end(args);
 }
 
+long long monotonic_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+long long thread_cpu_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return (long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
 bool parse_int(int *out, const char *str) {
 	// With the -a=b option syntax, 'str' will be "=b".
 	if (str[0] == '=' && str[1]) {
@@ -46,6 +60,26 @@ bool parse_int(int *out, const char *str) {
 	return true;
 }
 
+bool parse_long_long(long long *out, const char *str) {
+	if (str[0] == '=' && str[1]) {
+		str++;
+	}
+
+	char *end;
+	errno = 0;
+	long long n = strtoll(str, &end, 0);
+	if (*end) {
+		printf_error("%s: not an integer", str);
+		return false;
+	}
+	if (errno == ERANGE) {
+		printf_error("%s: out of range", str);
+		return false;
+	}
+	*out = n;
+	return true;
+}
+
 // Calls 'close_alt_screen' and then executes the default sigint handler.
 static void sigint_handler(int sig) {
 	close_alt_screen();
@@ -5,21 +5,43 @@
 
 #include <stdbool.h>
 
+// Size of a cache line, in bytes. Data written by different threads should be
+// at least this far apart to avoid false sharing.
+#define CACHE_LINE_SIZE 64
+
 // Macros for min and max.
 #define MIN(a,b) ((a) < (b) ? (a) : (b))
 #define MAX(a,b) ((a) > (b) ? (a) : (b))
 
+// Hints to the processor that we are in a spin loop.
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+	__asm__ __volatile__("yield");
+#endif
+}
+
 // Performs necessary setup. Must be called once when the program starts.
 void setup_util(const char *program_name);
 
 // Prints an error message to stderr with printf syntax.
 void printf_error(const char *format, ...);
 
+// Returns the current time of the monotonic clock, in nanoseconds.
+long long monotonic_ns(void);
+
+// Returns the CPU time used by the calling thread so far, in nanoseconds.
+long long thread_cpu_ns(void);
+
 // Parses a string as an int. Stores the result in 'out' and returns true on
 // success; prints an error message and returns false on failure. If 'str'
 // begins with an equals sign, it is ignored.
 bool parse_int(int *out, const char *str);
 
+// Like 'parse_int', but parses a long long.
+bool parse_long_long(long long *out, const char *str);
+
 // Make standard input unbuffered by turning off canonical mode.
 void use_unbuffered_input(void);
 
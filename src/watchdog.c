@@ -0,0 +1,146 @@
+// Copyright 2016 Mitchell Kember. Subject to the MIT License.
+
+#include "watchdog.h"
+
+#include "buffer.h"
+#include "semaphore.h"
+#include "util.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Maximum number of blocked threads listed for one scope.
+#define MAX_LISTED 64
+
+// Number of times the watchdog checks each scope per interval.
+#define CHECKS_PER_INTERVAL 4
+
+// Settings passed to 'watchdog_start'.
+static long long interval_ns;
+static size_t dump_events;
+
+// Problem that each scope (job) is running, for reports.
+static atomic_int job_problems[SEMA_WATCH_SCOPES];
+
+// Progress of one scope, as last seen by the watchdog.
+struct ScopeProgress {
+	unsigned long activity;  // value of 'sema_activity'
+	long long since_ns;      // when it last changed
+	bool reported;           // whether the stall since then was printed
+};
+
+// Prints a byte of an event, as a character if it is printable.
+static void print_byte(unsigned char c) {
+	if (c > ' ' && c < 127) {
+		fprintf(stderr, " %c", c);
+	} else {
+		fprintf(stderr, " %d", c);
+	}
+}
+
+// Prints the last 'dump_events' events of a log. Used with 'buf_visit_logs'.
+static void print_log(struct Buffer *buf, void *arg) {
+	(void)arg;
+	struct BufferEvent *events = malloc(dump_events * sizeof *events);
+	size_t n = buf_tail(buf, events, dump_events);
+	if (n > 0) {
+		fprintf(stderr, "  last %zu events in log (ms before the last):\n", n);
+	}
+	for (size_t i = 0; i < n; i++) {
+		long long before_ns = events[n - 1].time - events[i].time;
+		fprintf(stderr, "    %9.3f ", before_ns / 1e6);
+		unsigned char len = MIN(events[i].len, BUF_MAX_EVENT);
+		for (unsigned char j = 0; j < len; j++) {
+			print_byte(events[i].bytes[j]);
+		}
+		fputc('\n', stderr);
+	}
+	free(events);
+}
+
+// Prints the threads blocked in 'scope' and the end of its logs.
+static void report(int scope, long long stalled_ns) {
+	struct SemaBlocked blocked[MAX_LISTED];
+	size_t n = sema_blocked(scope, blocked, MAX_LISTED);
+	fprintf(stderr, "watchdog: problem %d (job %d) stalled for %lld ms with "
+			"%zu blocked thread%s\n", atomic_load(&job_problems[scope]), scope,
+			stalled_ns / 1000000, n, n == 1 ? "" : "s");
+	for (size_t i = 0; i < MIN(n, MAX_LISTED); i++) {
+		const struct SemaBlocked *b = &blocked[i];
+		if (b->role) {
+			fprintf(stderr, "  %s #%d", b->role, b->index);
+		} else {
+			fputs("  (main)", stderr);
+		}
+		fprintf(stderr, " waiting on %s", b->name);
+		if (b->value >= 0) {
+			fprintf(stderr, " (value %d)", b->value);
+		}
+		fputc('\n', stderr);
+	}
+	buf_visit_logs(scope, print_log, NULL);
+	fflush(stderr);
+}
+
+// Checks every scope periodically, reporting and aborting the stalled ones.
+// Once a scope is aborted, it keeps aborting it on every check while threads
+// remain blocked, since a thread can miss the wakeup. Never returns.
+static void *run_watchdog(void *arg) {
+	(void)arg;
+	struct ScopeProgress progress[SEMA_WATCH_SCOPES];
+	long long now = monotonic_ns();
+	for (int scope = 0; scope < SEMA_WATCH_SCOPES; scope++) {
+		progress[scope] = (struct ScopeProgress){
+			sema_activity(scope), now, false
+		};
+	}
+	for (;;) {
+		usleep((useconds_t)(interval_ns / 1000 / CHECKS_PER_INTERVAL));
+		now = monotonic_ns();
+		for (int scope = 0; scope < SEMA_WATCH_SCOPES; scope++) {
+			struct ScopeProgress *p = &progress[scope];
+			unsigned long activity = sema_activity(scope);
+			if (activity != p->activity) {
+				*p = (struct ScopeProgress){ activity, now, false };
+				continue;
+			}
+			if (now - p->since_ns < interval_ns
+					|| sema_blocked(scope, NULL, 0) == 0) {
+				continue;
+			}
+			if (!p->reported) {
+				report(scope, now - p->since_ns);
+				p->reported = true;
+			}
+			sema_abort_scope(scope);
+		}
+	}
+	return NULL;
+}
+
+bool watchdog_start(int interval_ms, int n_events) {
+	interval_ns = interval_ms * 1000000LL;
+	dump_events = (size_t)n_events;
+	sema_enable_watch(true);
+	buf_enable_watch(true);
+	pthread_t thread;
+	int err = pthread_create(&thread, NULL, run_watchdog, NULL);
+	if (err != 0) {
+		printf_error("error creating watchdog thread: %s", strerror(err));
+		return false;
+	}
+	pthread_detach(thread);
+	return true;
+}
+
+void watchdog_set_job(int job, int problem) {
+	if (job >= 0 && job < SEMA_WATCH_SCOPES) {
+		atomic_store(&job_problems[job], problem);
+	}
+	sema_set_watch_scope(job);
+	buf_set_scope(job);
+}
@@ -0,0 +1,23 @@
+// Copyright 2016 Mitchell Kember. Subject to the MIT License.
+
+#ifndef WATCHDOG_H
+#define WATCHDOG_H
+
+#include <stdbool.h>
+
+// Starts a thread that watches the semaphores of each scope (job) for
+// deadlocks. When threads are blocked on semaphores in a scope and none of its
+// semaphores have been signaled or waited on for 'interval_ms' milliseconds, it
+// prints the blocked threads and the last 'n_events' events of the scope's
+// logs to stderr, and aborts the scope's semaphores so that the test times
+// out. Must be called before any semaphores or logs are created. If there was
+// an error, prints an error message and returns false.
+bool watchdog_start(int interval_ms, int n_events);
+
+// Makes the semaphores and logs created afterwards by the calling thread part of
+// the scope of 'job' (less than SEMA_WATCH_SCOPES), which is now running
+// 'problem'. Each job must have its own scope, so that the progress of one does
+// not hide a stall in another, and aborting a stalled one leaves others alone.
+void watchdog_set_job(int job, int problem);
+
+#endif